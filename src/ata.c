@@ -3,22 +3,14 @@
 */
 
 #include "ata.h"
+#include "port.h"
+#include "trace.h"
 #include <stdint.h>
 
-static inline void outb(uint16_t port, uint8_t val) {
-    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
-}
-static inline uint8_t inb(uint16_t port) {
-    uint8_t ret;
-    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-static inline void insw(uint16_t port, void *addr, int cnt) {
-    __asm__ volatile ("rep insw" : "+D"(addr), "+c"(cnt) : "d"(port) : "memory");
-}
-static inline void outsw(uint16_t port, const void *addr, int cnt) {
-    __asm__ volatile ("rep outsw" : "+S"(addr), "+c"(cnt) : "d"(port));
-}
+#define ATA_SR_ERR  0x01
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_DF   0x20
+#define ATA_SR_BSY  0x80
 
 /* Wait 400ns (reading alt status port 4 times) */
 static void ata_delay() {
@@ -34,56 +26,90 @@ int ata_init(void) {
 }
 
 int ata_wait_busy(void) {
-    /* wait until BSY clear and DRQ set */
+    /* wait until BSY clear and DRQ set; fail on ERR/DF */
     for (int i = 0; i < 100000; i++) {
         uint8_t status = inb(0x1F7);
-        if (!(status & 0x80) && (status & 8)) return 0; // not busy, DRQ set
+        if (status & ATA_SR_BSY) continue;
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+        if (status & ATA_SR_DRQ) return 0; // not busy, DRQ set
     }
     return -1;
 }
 
-/* Read single sector LBA28 */
-int ata_read_sector(uint32_t lba, uint8_t *buffer) {
-    if (lba > 0x0FFFFFFF) return -1;
-    outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F)); // drive & lba(27..24)
-    outb(0x1F2, 1);   // sector count
-    outb(0x1F3, (uint8_t)(lba & 0xFF));
-    outb(0x1F4, (uint8_t)((lba >> 8) & 0xFF));
-    outb(0x1F5, (uint8_t)((lba >> 16) & 0xFF));
-    outb(0x1F7, 0x20); // READ PIO
-
-    // wait for data
+/* wait until BSY clear (used after the last sector / cache flush) */
+static int ata_wait_idle(void) {
     for (int i = 0; i < 100000; i++) {
         uint8_t status = inb(0x1F7);
-        if (status & 8) break; // DRQ
-        if (status & 1) return -1; // ERR
+        if (!(status & ATA_SR_BSY)) return (status & (ATA_SR_ERR | ATA_SR_DF)) ? -1 : 0;
     }
-
-    // read 256 words = 512 bytes
-    insw(0x1F0, buffer, 256);
-    ata_delay();
-    return 0;
+    return -1;
 }
 
-/* Write single sector LBA28 */
-int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
-    if (lba > 0x0FFFFFFF) return -1;
-    outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(0x1F2, 1);   // sector count
+/* program LBA28 registers and issue 'cmd' for 'count' sectors (1..256, 256 encoded as 0) */
+static void ata_issue(uint32_t lba, uint32_t count, uint8_t cmd) {
+    outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F)); // drive & lba(27..24)
+    outb(0x1F2, (uint8_t)(count & 0xFF));      // sector count
     outb(0x1F3, (uint8_t)(lba & 0xFF));
     outb(0x1F4, (uint8_t)((lba >> 8) & 0xFF));
     outb(0x1F5, (uint8_t)((lba >> 16) & 0xFF));
-    outb(0x1F7, 0x30); // WRITE PIO
+    outb(0x1F7, cmd);
+}
 
-    // wait for DRQ
-    for (int i = 0; i < 100000; i++) {
-        uint8_t status = inb(0x1F7);
-        if (status & 8) break; // DRQ
-        if (status & 1) return -1; // ERR
+/* Read 'count' sectors starting at LBA28 'lba'. Each READ command moves up to
+   ATA_MAX_SECTORS, so the per-command overhead is paid once per chunk instead
+   of once per sector. */
+int ata_read_sectors(uint32_t lba, uint32_t count, uint8_t *buffer) {
+    TRACE_SCOPE(TRACE_ATA_READ, count);
+    if (count == 0) return 0;
+    if (lba > 0x0FFFFFFF || count > 0x10000000 - lba) return -1;
+    while (count > 0) {
+        uint32_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        ata_issue(lba, n, 0x20); // READ PIO
+        for (uint32_t s = 0; s < n; s++) {
+            ata_delay();
+            if (ata_wait_busy() != 0) return -1;
+            // read 256 words = 512 bytes
+            insw(0x1F0, buffer, 256);
+            buffer += 512;
+        }
+        ata_delay();
+        lba += n;
+        count -= n;
+    }
+    return 0;
+}
+
+/* Write 'count' sectors starting at LBA28 'lba', chunked like ata_read_sectors.
+   The drive cache is flushed once after the whole transfer. */
+int ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    TRACE_SCOPE(TRACE_ATA_WRITE, count);
+    if (count == 0) return 0;
+    if (lba > 0x0FFFFFFF || count > 0x10000000 - lba) return -1;
+    while (count > 0) {
+        uint32_t n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        ata_issue(lba, n, 0x30); // WRITE PIO
+        for (uint32_t s = 0; s < n; s++) {
+            ata_delay();
+            if (ata_wait_busy() != 0) return -1;
+            outsw(0x1F0, buffer, 256);
+            buffer += 512;
+        }
+        ata_delay();
+        if (ata_wait_idle() != 0) return -1;
+        lba += n;
+        count -= n;
     }
-    outsw(0x1F0, buffer, 256);
-    ata_delay();
     // flush cache
     outb(0x1F7, 0xE7);
-    return 0;
+    return ata_wait_idle();
+}
+
+/* Read single sector LBA28 */
+int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+    return ata_read_sectors(lba, 1, buffer);
+}
+
+/* Write single sector LBA28 */
+int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+    return ata_write_sectors(lba, 1, buffer);
 }
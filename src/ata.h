@@ -2,8 +2,13 @@
 #define ATA_H
 #include <stdint.h>
 
+/* largest transfer a single LBA28 PIO command can move (count register 0 = 256) */
+#define ATA_MAX_SECTORS 256
+
 int ata_init(void);
 int ata_read_sector(uint32_t lba, uint8_t *buffer);
 int ata_write_sector(uint32_t lba, const uint8_t *buffer);
+int ata_read_sectors(uint32_t lba, uint32_t count, uint8_t *buffer);
+int ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buffer);
 
 #endif
@@ -0,0 +1,153 @@
+/* ata_host.c - file-backed block device for building fs.c on the host.
+   Not part of the kernel; see the fs_bench target in the Makefile.
+*/
+
+#include "ata.h"
+#include "ata_host.h"
+#include "slab.h"
+#include "kmalloc.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint8_t *disk;
+static uint32_t disk_sectors;
+static ata_host_stats_t stats;
+
+static int map_image(int fd, uint32_t sectors) {
+    void *p = mmap(NULL, (size_t)sectors * 512, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    disk = p;
+    disk_sectors = sectors;
+    return 0;
+}
+
+int ata_host_create(const char *path, uint32_t sectors) {
+    ata_host_close();
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)sectors * 512) != 0) { close(fd); return -1; }
+    return map_image(fd, sectors);
+}
+
+int ata_host_open(const char *path) {
+    ata_host_close();
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return -1;
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < 512) { close(fd); return -1; }
+    return map_image(fd, (uint32_t)(size / 512));
+}
+
+void ata_host_close(void) {
+    if (!disk) return;
+    munmap(disk, (size_t)disk_sectors * 512);
+    disk = NULL;
+    disk_sectors = 0;
+}
+
+void ata_host_get_stats(ata_host_stats_t *out) {
+    *out = stats;
+}
+
+void ata_host_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+/* ---------- ata.h ---------- */
+
+int ata_init(void) {
+    return disk ? 0 : -1;
+}
+
+int ata_read_sectors(uint32_t lba, uint32_t count, uint8_t *buffer) {
+    if (count == 0) return 0;
+    if (!disk || lba >= disk_sectors || count > disk_sectors - lba) return -1;
+    stats.read_cmds += (count + ATA_MAX_SECTORS - 1) / ATA_MAX_SECTORS;
+    stats.sectors_read += count;
+    memcpy(buffer, disk + (size_t)lba * 512, (size_t)count * 512);
+    return 0;
+}
+
+int ata_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buffer) {
+    if (count == 0) return 0;
+    if (!disk || lba >= disk_sectors || count > disk_sectors - lba) return -1;
+    stats.write_cmds += (count + ATA_MAX_SECTORS - 1) / ATA_MAX_SECTORS;
+    stats.sectors_written += count;
+    memcpy(disk + (size_t)lba * 512, buffer, (size_t)count * 512);
+    return 0;
+}
+
+int ata_read_sector(uint32_t lba, uint8_t *buffer) {
+    return ata_read_sectors(lba, 1, buffer);
+}
+
+int ata_write_sector(uint32_t lba, const uint8_t *buffer) {
+    return ata_write_sectors(lba, 1, buffer);
+}
+
+/* ---------- kernel services used by fs.c / bcache.c ---------- */
+
+struct kmem_cache {
+    size_t size;
+    void (*ctor)(void *obj);
+};
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, void (*ctor)(void *obj)) {
+    (void)name;
+    kmem_cache_t *c = malloc(sizeof(*c));
+    if (c) { c->size = size; c->ctor = ctor; }
+    return c;
+}
+
+/* every object is freshly allocated here, so construct it each time */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    void *obj = malloc(cache->size);
+    if (obj && cache->ctor) cache->ctor(obj);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    (void)cache;
+    free(obj);
+}
+
+void *kmalloc(size_t size) {
+    return malloc(size);
+}
+
+void kfree(void *ptr) {
+    free(ptr);
+}
+
+void printf_k(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+void printf_col(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+uint64_t trace_begin(uint16_t id, uint32_t arg) {
+    (void)id;
+    (void)arg;
+    return 0;
+}
+
+void trace_end(uint16_t id, uint64_t start) {
+    (void)id;
+    (void)start;
+}
@@ -0,0 +1,28 @@
+#ifndef ATA_HOST_H
+#define ATA_HOST_H
+
+#include <stdint.h>
+
+/* Host-side stand-in for ata.c: the disk is an mmap'd image file, and
+   every sector moved is counted so benchmarks can report I/O per
+   operation. ata_host.c also stubs the few kernel services fs.c and
+   bcache.c link against (kmalloc, object caches, printf_k, tracing). */
+
+typedef struct {
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t read_cmds;
+    uint64_t write_cmds;
+} ata_host_stats_t;
+
+/* create (or truncate) 'path' as a zero-filled image of 'sectors' sectors
+   and map it; returns 0 or -1 */
+int ata_host_create(const char *path, uint32_t sectors);
+/* map an existing image; returns 0 or -1 */
+int ata_host_open(const char *path);
+void ata_host_close(void);
+
+void ata_host_get_stats(ata_host_stats_t *out);
+void ata_host_reset_stats(void);
+
+#endif
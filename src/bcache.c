@@ -0,0 +1,157 @@
+/* bcache.c - write-back LRU sector cache.
+   Reads are served from RAM when the sector is resident; writes only mark
+   the entry dirty and reach the disk on eviction or bcache_flush(), so a
+   burst of updates to one sector costs a single ATA write, and a flush
+   sends each run of adjacent dirty sectors as one multi-sector write.
+*/
+
+#include "bcache.h"
+#include "ata.h"
+#include "slab.h"
+#include "kstring.h"
+#include <stdint.h>
+
+typedef struct {
+    uint32_t lba;
+    uint32_t last_used; /* LRU stamp, larger = more recent */
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t data[512];
+} bcache_entry_t;
+
+/* entries come from the "bcache" object cache as the working set grows */
+static bcache_entry_t *entries[BCACHE_ENTRIES];
+static int nentries;
+static kmem_cache_t *entry_cache;
+static uint32_t lru_clock = 0;
+static bcache_stats_t stats;
+
+static bcache_entry_t *lookup(uint32_t lba) {
+    for (int i = 0; i < nentries; i++) {
+        if (entries[i]->valid && entries[i]->lba == lba) return entries[i];
+    }
+    return 0;
+}
+
+static int writeback(bcache_entry_t *e) {
+    if (!e->dirty) return 0;
+    if (ata_write_sector(e->lba, e->data) != 0) return -1;
+    e->dirty = 0;
+    stats.writebacks++;
+    return 0;
+}
+
+/* pick a free entry, allocate a new one while below BCACHE_ENTRIES, or
+   evict the least recently used one (writing it back first) */
+static bcache_entry_t *victim(void) {
+    for (int i = 0; i < nentries; i++) {
+        if (!entries[i]->valid) return entries[i];
+    }
+    if (nentries < BCACHE_ENTRIES) {
+        if (!entry_cache) entry_cache = kmem_cache_create("bcache", sizeof(bcache_entry_t), 0);
+        bcache_entry_t *e = (bcache_entry_t*)kmem_cache_alloc(entry_cache);
+        if (e) {
+            e->valid = 0;
+            e->dirty = 0;
+            entries[nentries++] = e;
+            return e;
+        }
+    }
+    if (nentries == 0) return 0;
+    bcache_entry_t *lru = entries[0];
+    for (int i = 1; i < nentries; i++) {
+        if (entries[i]->last_used < lru->last_used) lru = entries[i];
+    }
+    if (writeback(lru) != 0) return 0;
+    lru->valid = 0;
+    stats.evictions++;
+    return lru;
+}
+
+int bcache_read(uint32_t lba, void *buf) {
+    bcache_entry_t *e = lookup(lba);
+    if (e) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+        e = victim();
+        if (!e) return -1;
+        if (ata_read_sector(lba, e->data) != 0) return -1;
+        e->lba = lba;
+        e->dirty = 0;
+        e->valid = 1;
+    }
+    e->last_used = ++lru_clock;
+    kmemcpy(buf, e->data, 512);
+    return 0;
+}
+
+int bcache_write(uint32_t lba, const void *buf) {
+    bcache_entry_t *e = lookup(lba);
+    if (e) {
+        stats.hits++;
+    } else {
+        /* full-sector overwrite: no need to read the old contents */
+        stats.misses++;
+        e = victim();
+        if (!e) return -1;
+        e->lba = lba;
+        e->valid = 1;
+    }
+    kmemcpy(e->data, buf, 512);
+    e->dirty = 1;
+    e->last_used = ++lru_clock;
+    return 0;
+}
+
+/* write run[0..n), entries with consecutive LBAs, as one ATA command */
+static int writeback_run(bcache_entry_t **run, int n) {
+    static uint8_t run_buf[BCACHE_ENTRIES * 512];
+    if (n == 1) return writeback(run[0]);
+    for (int k = 0; k < n; k++) kmemcpy(run_buf + k * 512, run[k]->data, 512);
+    if (ata_write_sectors(run[0]->lba, (uint32_t)n, run_buf) != 0) return -1;
+    for (int k = 0; k < n; k++) run[k]->dirty = 0;
+    stats.writebacks += (uint32_t)n;
+    return 0;
+}
+
+/* write the dirty sectors in [lba, lba+count) back in LBA order, one
+   command per run of adjacent sectors; entries stay cached (clean) */
+int bcache_flush_range(uint32_t lba, uint32_t count) {
+    bcache_entry_t *dirty[BCACHE_ENTRIES];
+    int n = 0;
+    for (int i = 0; i < nentries; i++) {
+        bcache_entry_t *e = entries[i];
+        if (!e->valid || !e->dirty || e->lba - lba >= count) continue;
+        int j = n++;
+        for (; j > 0 && dirty[j - 1]->lba > e->lba; j--) dirty[j] = dirty[j - 1];
+        dirty[j] = e;
+    }
+    int rc = 0;
+    for (int i = 0; i < n; ) {
+        int j = i + 1;
+        while (j < n && dirty[j]->lba == dirty[j - 1]->lba + 1) j++;
+        if (writeback_run(&dirty[i], j - i) != 0) rc = -1;
+        i = j;
+    }
+    return rc;
+}
+
+/* write every dirty sector back to disk */
+int bcache_flush(void) {
+    return bcache_flush_range(0, 0xFFFFFFFFu);
+}
+
+/* drop cached copies of [lba, lba+count) without writing them back */
+void bcache_invalidate(uint32_t lba, uint32_t count) {
+    for (int i = 0; i < nentries; i++) {
+        if (entries[i]->valid && entries[i]->lba - lba < count) {
+            entries[i]->valid = 0;
+            entries[i]->dirty = 0;
+        }
+    }
+}
+
+void bcache_get_stats(bcache_stats_t *out) {
+    if (out) *out = stats;
+}
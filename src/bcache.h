@@ -0,0 +1,25 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+#include <stdint.h>
+
+/* Small write-back LRU cache of 512-byte sectors sitting between the
+   filesystem metadata paths and the ATA driver. */
+
+#define BCACHE_ENTRIES 32
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t writebacks; /* dirty sectors written to disk */
+    uint32_t evictions;  /* valid entries replaced to make room */
+} bcache_stats_t;
+
+int bcache_read(uint32_t lba, void *buf);
+int bcache_write(uint32_t lba, const void *buf);
+int bcache_flush(void);
+/* flush only the dirty sectors in [lba, lba+count), lowest LBA first */
+int bcache_flush_range(uint32_t lba, uint32_t count);
+void bcache_invalidate(uint32_t lba, uint32_t count);
+void bcache_get_stats(bcache_stats_t *out);
+
+#endif
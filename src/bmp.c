@@ -1,20 +1,21 @@
 /* bmp_vga13.c - TRUE VGA mode 13h BMP renderer
  * Supports 8 / 24 / 32 bpp BMP
- * Renders scaled to 320x200 using direct VGA memory
+ * Renders scaled to 320x200 into the mode 13h back buffer and presents
+ * the finished picture in one copy
  */
 
 #include <stdint.h>
 #include "fs.h"
 #include "io.h"
 #include "vga_mode13.h"
+#include "port.h"
 
-#define BMP_MAX_FILE 131072
+#define BMP_MAX_ROW 16384   /* widest row we decode: 4096 px at 32 bpp */
+#define BMP_MAX_W   (BMP_MAX_ROW / 4)
+#define BMP_MAX_H   32768   /* keeps row offsets and scaling math in range */
 #define VGA_W 320
 #define VGA_H 200
 
-/* VGA framebuffer */
-#define VGA_FB ((uint8_t*)0xA0000)
-
 /* ---------------- Little-endian helpers ---------------- */
 
 static inline uint16_t rd16(const uint8_t *p) {
@@ -40,81 +41,100 @@ static void vga_set_6x6x6_palette(void) {
 }
 
 /* Load BMP 256-color palette */
-static void vga_load_bmp_palette(const uint8_t *bmp, uint32_t pal_off) {
+static int vga_load_bmp_palette(int fd, uint32_t pal_off) {
+    uint8_t pal[256 * 4];
+    if (fs_pread(fd, pal_off, pal, sizeof(pal)) != (int)sizeof(pal)) return -1;
     outb(0x3C8, 0);
     for (int i = 0; i < 256; i++) {
-        uint8_t b = bmp[pal_off + i * 4 + 0];
-        uint8_t g = bmp[pal_off + i * 4 + 1];
-        uint8_t r = bmp[pal_off + i * 4 + 2];
+        uint8_t b = pal[i * 4 + 0];
+        uint8_t g = pal[i * 4 + 1];
+        uint8_t r = pal[i * 4 + 2];
         outb(0x3C9, r >> 2);
         outb(0x3C9, g >> 2);
         outb(0x3C9, b >> 2);
     }
+    return 0;
 }
 
 /* ---------------- BMP renderer ---------------- */
 
+/* Rows are streamed from disk one at a time; only the current source row
+ * is resident, and it is reused while vertical downscaling repeats it. */
 int bmp_draw_mode13(const char *name) {
-    static uint8_t file[BMP_MAX_FILE];
+    static uint8_t rowbuf[BMP_MAX_ROW];
+    uint8_t hdr[54];
 
-    int size = fs_read_file(name, file, BMP_MAX_FILE);
-    if (size < 54) return -1;
+    int fd = fs_open(name, FS_O_READ);
+    if (fd < 0) return -1;
 
-    if (file[0] != 'B' || file[1] != 'M') return -1;
+    int rc = -1;
+    if (fs_pread(fd, 0, hdr, sizeof(hdr)) != (int)sizeof(hdr)) goto out;
 
-    uint32_t data_off = rd32(file + 10);
-    uint32_t hdr_sz   = rd32(file + 14);
-    int32_t  w        = (int32_t)rd32(file + 18);
-    int32_t  h        = (int32_t)rd32(file + 22);
-    uint16_t bpp      = rd16(file + 28);
-    uint32_t comp     = rd32(file + 30);
+    if (hdr[0] != 'B' || hdr[1] != 'M') goto out;
 
-    if (comp != 0 || w <= 0) return -1;
+    uint32_t data_off = rd32(hdr + 10);
+    uint32_t hdr_sz   = rd32(hdr + 14);
+    int32_t  w        = (int32_t)rd32(hdr + 18);
+    int32_t  h        = (int32_t)rd32(hdr + 22);
+    uint16_t bpp      = rd16(hdr + 28);
+    uint32_t comp     = rd32(hdr + 30);
+
+    /* bound the header before any arithmetic on it */
+    if (comp != 0 || w <= 0 || w > BMP_MAX_W || h == 0) goto out;
+    if (h < -BMP_MAX_H || h > BMP_MAX_H) goto out;
 
     int top_down = 0;
     if (h < 0) { top_down = 1; h = -h; }
 
+    uint32_t uw = (uint32_t)w;
+    uint32_t row_bytes;
+    if (bpp == 24) row_bytes = (uw * 3 + 3) & ~3U;
+    else if (bpp == 32) row_bytes = uw * 4;
+    else if (bpp == 8) row_bytes = (uw + 3) & ~3U;
+    else goto out;
+    if (row_bytes > BMP_MAX_ROW) goto out;
+
     /* Switch to VGA */
     vga_set_mode13();
     vga_clear_mode13(0);
 
     if (bpp == 8) {
         uint32_t pal_off = 14 + hdr_sz;
-        vga_load_bmp_palette(file, pal_off);
+        if (vga_load_bmp_palette(fd, pal_off) != 0) goto out;
     } else {
         vga_set_6x6x6_palette();
     }
 
-    uint32_t row_bytes;
-    if (bpp == 24) row_bytes = (w * 3 + 3) & ~3U;
-    else if (bpp == 32) row_bytes = w * 4;
-    else if (bpp == 8) row_bytes = (w + 3) & ~3U;
-    else return -1;
-
+    uint8_t *fb = vga_backbuffer(); /* vga_clear_mode13 marked all of it dirty */
+    int cached_row = -1;
     for (int y = 0; y < VGA_H; y++) {
         int sy = (y * h) / VGA_H;
         int row = top_down ? sy : (h - 1 - sy);
 
+        if (row != cached_row) {
+            uint32_t p = data_off + row * row_bytes;
+            if (fs_pread(fd, p, rowbuf, row_bytes) != (int)row_bytes) goto out;
+            cached_row = row;
+        }
+
         for (int x = 0; x < VGA_W; x++) {
             int sx = (x * w) / VGA_W;
             uint8_t col = 0;
 
-            uint32_t p = data_off + row * row_bytes;
-
             if (bpp == 8) {
-                col = file[p + sx];
+                col = rowbuf[sx];
             } else {
                 uint8_t r, g, b;
                 if (bpp == 24) {
-                    uint32_t o = p + sx * 3;
-                    b = file[o + 0];
-                    g = file[o + 1];
-                    r = file[o + 2];
+                    uint32_t o = sx * 3;
+                    b = rowbuf[o + 0];
+                    g = rowbuf[o + 1];
+                    r = rowbuf[o + 2];
                 } else {
-                    uint32_t o = p + sx * 4;
-                    b = file[o + 0];
-                    g = file[o + 1];
-                    r = file[o + 2];
+                    uint32_t o = sx * 4;
+                    b = rowbuf[o + 0];
+                    g = rowbuf[o + 1];
+                    r = rowbuf[o + 2];
                 }
                 int r6 = (r * 5) / 255;
                 int g6 = (g * 5) / 255;
@@ -122,9 +142,13 @@ int bmp_draw_mode13(const char *name) {
                 col = r6 * 36 + g6 * 6 + b6;
             }
 
-            VGA_FB[y * VGA_W + x] = col;
+            fb[y * VGA_W + x] = col;
         }
     }
+    vga_present();
+    rc = 0;
 
-    return 0;
+out:
+    fs_close(fd);
+    return rc;
 }
@@ -2,8 +2,15 @@
     .section .multiboot
     .align 4
     .long 0x1BADB002      /* magic */
-    .long 0x0             /* flags (no mods) */
-    .long -(0x1BADB002)   /* checksum */
+    .long 0x2             /* flags: request mem_* and the memory map */
+    .long -(0x1BADB002 + 0x2) /* checksum */
+
+    /* boot stack lives in .bss, so the PMM sees it as part of the kernel image */
+    .section .bss
+    .align 16
+stack_bottom:
+    .skip 65536
+stack_top:
 
     .text
     .global start
@@ -11,8 +18,8 @@
 
 start:
     cli
-    /* Set up stack (simple) */
-    mov $0x90000, %esp
+    /* Set up stack */
+    mov $stack_top, %esp
 
     /* Call kernel_main with multiboot magic & addr as passed by the bootloader
      * According to the Multiboot spec: on entry EAX = magic, EBX = pointer to
@@ -0,0 +1,153 @@
+/* elf.c - loads programs from the filesystem into their own address space.
+   Nothing is copied at load time: the headers are validated and each
+   segment becomes a vm area backed by the open file, and the page fault
+   handler in vmm.c reads a page only when the program touches it.
+*/
+
+#include "elf.h"
+#include "fs.h"
+#include "pmm.h"
+#include "kstring.h"
+#include "trace.h"
+#include "sched.h"
+#include "syscall.h"
+
+#define ELF_MAX_PHDRS 16
+
+extern int user_enter(uint32_t eip, uint32_t esp);          /* user_entry.s */
+extern void user_resume(uint32_t frame, int code) __attribute__((noreturn));
+
+static int user_ready;
+
+int elf_init(void) {
+    uint32_t frames = (USER_LIMIT - USER_BASE) / PMM_FRAME_SIZE;
+    uint32_t before = pmm_free_count();
+    pmm_reserve(USER_BASE, USER_LIMIT - USER_BASE);
+    /* every frame must have been free RAM, or part of the region is missing */
+    user_ready = (before - pmm_free_count() == frames);
+    return user_ready ? 0 : -1;
+}
+
+/* a file that is not ELF: map it at USER_BASE and enter at its first byte */
+static int load_flat(vmm_space_t *vs, uint32_t size, uint32_t *entry) {
+    if (size > USER_STACK_BASE - USER_BASE) return -1;
+    if (vmm_add_area(vs, USER_BASE, USER_BASE + size, 0, size, 1) != 0) return -1;
+    *entry = USER_BASE;
+    return 0;
+}
+
+static int load_elf(vmm_space_t *vs, uint32_t size, const Elf32_Ehdr *eh, uint32_t *entry) {
+    if (eh->e_ident[4] != ELFCLASS32 || eh->e_ident[5] != ELFDATA2LSB) return -1;
+    if (eh->e_machine != EM_386) return -1;
+    if (eh->e_type != ET_EXEC && eh->e_type != ET_DYN) return -1;
+    if (eh->e_phentsize != sizeof(Elf32_Phdr)) return -1;
+    if (eh->e_phnum == 0 || eh->e_phnum > ELF_MAX_PHDRS) return -1;
+
+    Elf32_Phdr ph[ELF_MAX_PHDRS];
+    uint32_t phsize = eh->e_phnum * sizeof(Elf32_Phdr);
+    if (eh->e_phoff > size || phsize > size - eh->e_phoff) return -1;
+    if (fs_pread(vs->fd, eh->e_phoff, ph, phsize) != (int)phsize) return -1;
+
+    /* position-independent images go at USER_BASE, executables where linked */
+    uint32_t bias = 0;
+    if (eh->e_type == ET_DYN) {
+        uint32_t low = 0xFFFFFFFFu;
+        for (int i = 0; i < eh->e_phnum; i++)
+            if (ph[i].p_type == PT_LOAD && ph[i].p_memsz && ph[i].p_vaddr < low) low = ph[i].p_vaddr;
+        if (low == 0xFFFFFFFFu) return -1;
+        bias = USER_BASE - (low & ~(PMM_FRAME_SIZE - 1));
+    }
+
+    int entry_ok = 0;
+    uint32_t start = eh->e_entry + bias;
+    for (int i = 0; i < eh->e_phnum; i++) {
+        const Elf32_Phdr *p = &ph[i];
+        if (p->p_type != PT_LOAD || p->p_memsz == 0) continue;
+        uint32_t va = p->p_vaddr + bias;
+        if (p->p_filesz > p->p_memsz) return -1;
+        if (p->p_offset > size || p->p_filesz > size - p->p_offset) return -1;
+        if (va < USER_BASE || va >= USER_STACK_BASE || p->p_memsz > USER_STACK_BASE - va) return -1;
+        if (vmm_add_area(vs, va, va + p->p_memsz, p->p_offset, p->p_filesz, (p->p_flags & PF_W) != 0) != 0)
+            return -1;
+        if (start >= va && start - va < p->p_memsz) entry_ok = 1;
+    }
+    if (!entry_ok) return -1;
+    *entry = start;
+    return 0;
+}
+
+int elf_load(const char *name, vmm_space_t **space, uint32_t *entry) {
+    if (!user_ready || !name || !space || !entry) return -1;
+    int fd = fs_open(name, FS_O_READ);
+    if (fd < 0) return -1;
+    vmm_space_t *vs = vmm_create(fd);
+    if (!vs) { fs_close(fd); return -1; }
+
+    int rc = -1;
+    int size = fs_fsize(fd);
+    Elf32_Ehdr eh;
+    if (size > 0) {
+        if ((uint32_t)size >= sizeof(eh) &&
+            fs_pread(fd, 0, &eh, sizeof(eh)) == (int)sizeof(eh) &&
+            kmemcmp(eh.e_ident, ELFMAG, SELFMAG) == 0)
+            rc = load_elf(vs, (uint32_t)size, &eh, entry);
+        else
+            rc = load_flat(vs, (uint32_t)size, entry);
+    }
+    if (rc == 0) rc = vmm_add_area(vs, USER_STACK_BASE, USER_LIMIT, 0, 0, 1);
+    if (rc != 0) { vmm_destroy(vs); return -1; }
+    *space = vs;
+    return 0;
+}
+
+/* Run the program loaded in the current address space in ring 3 until it
+   exits. Its stack starts below a stub that makes the exit call, so a
+   program whose entry point simply returns ends the same way. */
+static int run_user(uint32_t entry) {
+    static const uint8_t exit_stub[] = {
+        0x89, 0xC3,               /* mov %eax, %ebx: the return value is the status */
+        0xB8, SYS_EXIT, 0, 0, 0,  /* mov $SYS_EXIT, %eax */
+        0xCD, 0x80,               /* int $0x80 */
+        0xEB, 0xFE,               /* jmp . */
+    };
+    uint8_t *stub = (uint8_t*)(uintptr_t)(USER_LIMIT - 16);
+    kmemcpy(stub, exit_stub, sizeof(exit_stub));
+    uint32_t *sp = (uint32_t*)(uintptr_t)(USER_LIMIT - 20);
+    *sp = (uint32_t)(uintptr_t)stub;
+    uint32_t count = preempt_save(); /* program code may always be preempted */
+    int code = user_enter(entry, (uint32_t)(uintptr_t)sp);
+    preempt_restore(count);
+    return code;
+}
+
+void elf_exit(int code) {
+    uint32_t frame = sched_kernel_stack();
+    if (!frame) return; /* not inside a program */
+    sched_set_kernel_stack(0);
+    user_resume(frame, code);
+}
+
+int elf_run(const char *name) {
+    TRACE_SCOPE(TRACE_ELF_RUN, 0);
+    vmm_space_t *vs;
+    uint32_t entry;
+    if (elf_load(name, &vs, &entry) != 0) return -1;
+    vmm_space_t *prev = vmm_switch(vs);
+    run_user(entry);
+    vmm_switch(prev);
+    vmm_destroy(vs);
+    return 0;
+}
+
+static void program_main(void *entry) {
+    run_user((uint32_t)(uintptr_t)entry);
+}
+
+int elf_spawn(const char *name) {
+    vmm_space_t *vs;
+    uint32_t entry;
+    if (elf_load(name, &vs, &entry) != 0) return -1;
+    int tid = thread_create(name, program_main, (void*)(uintptr_t)entry, vs);
+    if (tid < 0) vmm_destroy(vs);
+    return tid;
+}
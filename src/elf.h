@@ -0,0 +1,74 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+#include "vmm.h"
+
+/* ELF32 program loader. Every program gets its own address space (see
+   vmm.h): ET_EXEC binaries must be linked inside the user region (see
+   user.ld), ET_DYN ones are placed at USER_BASE, and flat binaries are
+   mapped at USER_BASE and called at their first byte. Loading only
+   validates the headers and registers each PT_LOAD segment, plus a
+   USER_STACK_SIZE stack at the top of the region, as an area;
+   pages are read from the file when the program first touches them, and
+   the p_memsz - p_filesz tail is zero-filled the same way. */
+
+#define ELFMAG      "\177ELF"
+#define SELFMAG     4
+#define ELFCLASS32  1
+#define ELFDATA2LSB 1
+#define ET_EXEC     2
+#define ET_DYN      3
+#define EM_386      3
+#define PT_LOAD     1
+#define PF_W        2
+
+typedef struct {
+    unsigned char e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} __attribute__((packed)) Elf32_Ehdr;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} __attribute__((packed)) Elf32_Phdr;
+
+/* keep physical USER_BASE..USER_LIMIT away from the PMM; call right
+   after pmm_init. Returns -1 if RAM does not cover the whole region */
+int elf_init(void);
+
+/* build an address space for 'name'; stores it and the entry address */
+int elf_load(const char *name, vmm_space_t **space, uint32_t *entry);
+
+/* run 'name' in ring 3 in its own address space, which is torn down when
+   the program exits; returns 0 then, -1 if it could not load */
+int elf_run(const char *name);
+
+/* end the current program (SYS_EXIT, or a fault in ring 3): unwinds to
+   where it was started. Returns only if no program is running */
+void elf_exit(int code);
+
+/* load 'name' and start it in a thread of its own, which tears the
+   address space down when the program returns or is killed; returns
+   the tid or -1 */
+int elf_spawn(const char *name);
+
+#endif
@@ -0,0 +1,85 @@
+/* exc_entry.s - entry stubs for the 32 CPU exceptions (vectors 0x00-0x1F).
+ * Vectors that do not push an error code push a zero instead, so every
+ * stub leaves the same exc_frame_t (interrupt.h) for exception_dispatch.
+ * The faulting code's DS/ES are saved below that frame and the kernel's
+ * loaded, since a program may leave any selector there.
+ */
+    .section .text
+
+    .macro EXC_NOERR n
+exc_stub_\n:
+    pushl $0
+    pushl $\n
+    jmp exc_common
+    .endm
+
+    .macro EXC_ERR n
+exc_stub_\n:
+    pushl $\n
+    jmp exc_common
+    .endm
+
+    EXC_NOERR 0
+    EXC_NOERR 1
+    EXC_NOERR 2
+    EXC_NOERR 3
+    EXC_NOERR 4
+    EXC_NOERR 5
+    EXC_NOERR 6
+    EXC_NOERR 7
+    EXC_ERR   8
+    EXC_NOERR 9
+    EXC_ERR   10
+    EXC_ERR   11
+    EXC_ERR   12
+    EXC_ERR   13
+    EXC_ERR   14
+    EXC_NOERR 15
+    EXC_NOERR 16
+    EXC_ERR   17
+    EXC_NOERR 18
+    EXC_NOERR 19
+    EXC_NOERR 20
+    EXC_ERR   21
+    EXC_NOERR 22
+    EXC_NOERR 23
+    EXC_NOERR 24
+    EXC_NOERR 25
+    EXC_NOERR 26
+    EXC_NOERR 27
+    EXC_NOERR 28
+    EXC_ERR   29
+    EXC_ERR   30
+    EXC_NOERR 31
+
+exc_common:
+    pushal
+    pushl %ds
+    pushl %es
+    movw $0x10, %ax                 /* GDT_KERNEL_DATA */
+    movw %ax, %ds
+    movw %ax, %es
+    cld
+    leal 8(%esp), %eax              /* the frame starts above the segments */
+    pushl %eax
+    call exception_dispatch
+    addl $4, %esp
+    popl %es
+    popl %ds
+    popal
+    addl $8, %esp   /* drop the vector and error code */
+    iret
+
+    /* table used by idt_init to fill vectors 0x00-0x1F */
+    .section .rodata
+    .globl exc_stubs
+    .align 4
+exc_stubs:
+    .long exc_stub_0, exc_stub_1, exc_stub_2, exc_stub_3
+    .long exc_stub_4, exc_stub_5, exc_stub_6, exc_stub_7
+    .long exc_stub_8, exc_stub_9, exc_stub_10, exc_stub_11
+    .long exc_stub_12, exc_stub_13, exc_stub_14, exc_stub_15
+    .long exc_stub_16, exc_stub_17, exc_stub_18, exc_stub_19
+    .long exc_stub_20, exc_stub_21, exc_stub_22, exc_stub_23
+    .long exc_stub_24, exc_stub_25, exc_stub_26, exc_stub_27
+    .long exc_stub_28, exc_stub_29, exc_stub_30, exc_stub_31
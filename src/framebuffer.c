@@ -1,30 +1,9 @@
 #include "framebuffer.h"
 #include <stdint.h>
 #include "io.h"
+#include "multiboot.h"
+#include "kstring.h"
 
-/* Minimal multiboot info struct (multiboot v1 layout) */
-typedef struct multiboot_info {
-    uint32_t flags;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-    uint32_t boot_device;
-    uint32_t cmdline;
-    uint32_t mods_count;
-    uint32_t mods_addr;
-    uint32_t syms[4];
-    uint32_t mmap_length;
-    uint32_t mmap_addr;
-    uint32_t drives_length;
-    uint32_t drives_addr;
-    uint32_t config_table;
-    uint32_t boot_loader_name;
-    uint32_t apm_table;
-    uint32_t vbe_control_info;
-    uint32_t vbe_mode;
-    uint32_t vbe_interface_seg;
-    uint32_t vbe_interface_off;
-    uint32_t vbe_interface_len;
-} multiboot_info_t;
 
 /* Runtime framebuffer state */
 static volatile uint8_t *fb_ptr = 0;
@@ -144,6 +123,26 @@ void fb_clear(uint32_t color) {
     }
 }
 
+int fb_blit(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t *src, uint32_t pitch) {
+    if (!fb_is_available || x >= fb_w || y >= fb_h || w == 0 || h == 0) return -1;
+    if (w > fb_w - x) w = fb_w - x;
+    if (h > fb_h - y) h = fb_h - y;
+    uint8_t *row = (uint8_t*)fb_ptr + y * fb_pitch_bytes + x * (fb_bpp/8);
+    for (uint32_t r = 0; r < h; r++, row += fb_pitch_bytes, src += pitch) {
+        if (fb_bpp == 32) {
+            kmemcpy(row, src, w * 4);
+        } else {
+            uint8_t *p = row;
+            for (uint32_t c = 0; c < w; c++, p += 3) {
+                p[0] = (uint8_t)(src[c] & 0xFF);
+                p[1] = (uint8_t)((src[c] >> 8) & 0xFF);
+                p[2] = (uint8_t)((src[c] >> 16) & 0xFF);
+            }
+        }
+    }
+    return 0;
+}
+
 void fb_status(char *buf, int buflen) {
     if (!buf || buflen <= 0) return;
     if (fb_is_available) {
@@ -21,6 +21,11 @@ uint32_t fb_bpp(void);
 void fb_putpixel(uint32_t x, uint32_t y, uint32_t color); /* color: 0xRRGGBB */
 void fb_clear(uint32_t color);
 
+/* Copy a w x h block of 0xRRGGBB pixels ('pitch' pixels per source row)
+ * to (x,y), clipped to the screen; -1 if unavailable or fully off screen
+ */
+int fb_blit(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t *src, uint32_t pitch);
+
 /* Return human-readable status (for diagnostics). Buffer must be >= 64 bytes */
 void fb_status(char *buf, int buflen);
 
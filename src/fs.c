@@ -4,24 +4,16 @@
 
 #include "fs.h"
 #include "ata.h"
+#include "bcache.h"
+#include "kmalloc.h"
+#include "slab.h"
+#include "trace.h"
+#include "kstring.h"
 #include <stdint.h>
 #include "io.h"
 /* ------------------ small kernel-safe helpers ------------------ */
-/* We implement tiny versions of memcpy/memset/strlen/strncpy/strncmp
-   as static so they don't conflict with external libraries. */
-
-static void *memcpy_small(void *dst, const void *src, uint32_t n) {
-    uint8_t *d = (uint8_t*)dst;
-    const uint8_t *s = (const uint8_t*)src;
-    for (uint32_t i = 0; i < n; i++) d[i] = s[i];
-    return dst;
-}
-
-static void *memset_small(void *dst, int value, uint32_t n) {
-    uint8_t *d = (uint8_t*)dst;
-    for (uint32_t i = 0; i < n; i++) d[i] = (uint8_t)value;
-    return dst;
-}
+/* We implement tiny versions of strlen/strncpy/strncmp as static so they
+   don't conflict with external libraries; mem* come from kstring.c. */
 
 static uint32_t strlen_small(const char *s) {
     uint32_t c = 0;
@@ -49,419 +41,911 @@ static int strncmp_small(const char *a, const char *b, uint32_t n) {
     return 0;
 }
 
-/* ---------- Layout/constants (same as before) ---------- */
-#define FS_SUPER_LBA    1
-#define FS_BITMAP_LBA   2
-#define FS_BITMAP_SECTS 16
-#define FS_ROOT_LBA     (FS_BITMAP_LBA + FS_BITMAP_SECTS)
-#define FS_ROOT_SECTS   8
-#define FS_DATA_LBA     (FS_ROOT_LBA + FS_ROOT_SECTS)
-
-#define FS_MAX_FILES    128
-#define FS_FILENAME_MAX 32
-#define FS_BLOCK_SIZE   512
-
-/* superblock structure (stored in LBA 1) */
-typedef struct {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t total_sectors;
-    uint32_t data_lba;
-    uint8_t  reserved[512 - 16];
-} __attribute__((packed)) fs_super_t;
-
-/* directory entry */
-typedef struct {
-    char name[FS_FILENAME_MAX];
-    uint32_t start_block; /* LBA of first block */
-    uint32_t size;        /* in bytes */
-    uint8_t used;
-    uint8_t pad[3];
-} __attribute__((packed)) fs_dirent_t;
-
 /* in-memory cache sectors */
 static uint8_t sector_buf[512];
 static fs_super_t superblock;
 static int fs_ready = 0;
 
-/* helpers to call ATA */
+/* metadata sectors (superblock, bitmap, root dir) go through the write-back
+   sector cache; dirty entries reach the disk at the end of each operation */
 static int read_sector(uint32_t lba, void *buf) {
-    return ata_read_sector(lba, (uint8_t*)buf);
+    TRACE_SCOPE(TRACE_FS_META_READ, lba);
+    return bcache_read(lba, buf);
 }
 static int write_sector(uint32_t lba, const void *buf) {
-    return ata_write_sector(lba, (const uint8_t*)buf);
+    TRACE_SCOPE(TRACE_FS_META_WRITE, lba);
+    return bcache_write(lba, buf);
+}
+/* file data bypasses the cache: one ATA command per 256 contiguous sectors */
+static int read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    return ata_read_sectors(lba, count, (uint8_t*)buf);
+}
+static int write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    return ata_write_sectors(lba, count, (const uint8_t*)buf);
+}
+
+/* ---------- In-memory block bitmap ----------
+   The 16 bitmap sectors are loaded once at mount time. Allocation scans
+   32 bits at a time and only the sectors touched since the last sync are
+   written back. Bit i tracks data block FS_DATA_LBA + i. Blocks a file
+   lets go of are only noted in bitmap_freed and stay allocated until
+   fs_sync has written the metadata that no longer points at them. */
+#define FS_BITMAP_WORDS (FS_BITMAP_SECTS * FS_SECTOR / 4)
+#define FS_BITMAP_BITS  (FS_BITMAP_WORDS * 32)
+
+static uint32_t bitmap[FS_BITMAP_WORDS];
+static uint32_t bitmap_dirty;  /* bit s set => bitmap sector s needs writing */
+static uint32_t bitmap_blocks; /* data blocks actually present on the disk */
+static uint32_t bitmap_freed[FS_BITMAP_WORDS]; /* released, still set in bitmap */
+static uint32_t freed_dirty;   /* bit s set => bitmap_freed has bits in sector s */
+
+static int bitmap_load(void) {
+    if (read_sectors(FS_BITMAP_LBA, FS_BITMAP_SECTS, bitmap) != 0) return -1;
+    bitmap_dirty = 0;
+    kmemset(bitmap_freed, 0, sizeof(bitmap_freed));
+    freed_dirty = 0;
+    bitmap_blocks = FS_BITMAP_BITS;
+    if (superblock.total_sectors > FS_DATA_LBA &&
+        superblock.total_sectors - FS_DATA_LBA < FS_BITMAP_BITS)
+        bitmap_blocks = superblock.total_sectors - FS_DATA_LBA;
+    /* blocks past the end of the disk are permanently "in use" */
+    for (uint32_t b = bitmap_blocks; b < FS_BITMAP_BITS; ) {
+        if ((b & 31) == 0) { bitmap[b / 32] = 0xFFFFFFFFu; b += 32; }
+        else { bitmap[b / 32] |= 1u << (b & 31); b++; }
+    }
+    return 0;
+}
+
+/* write dirty bitmap sectors, coalescing adjacent ones into one request */
+static int bitmap_sync(void) {
+    uint32_t s = 0;
+    while (s < FS_BITMAP_SECTS) {
+        if (!(bitmap_dirty & (1u << s))) { s++; continue; }
+        uint32_t first = s;
+        while (s < FS_BITMAP_SECTS && (bitmap_dirty & (1u << s))) s++;
+        const uint8_t *src = (const uint8_t*)bitmap + first * FS_SECTOR;
+        if (write_sectors(FS_BITMAP_LBA + first, s - first, src) != 0) return -1;
+    }
+    bitmap_dirty = 0;
+    return 0;
+}
+
+/* first free bit at or after 'bit' (bitmap_blocks if none); skips full words */
+static uint32_t bitmap_next_free(uint32_t bit) {
+    while (bit < bitmap_blocks) {
+        uint32_t free_bits = ~bitmap[bit / 32] >> (bit & 31);
+        if (free_bits) {
+            bit += (uint32_t)__builtin_ctz(free_bits);
+            return bit < bitmap_blocks ? bit : bitmap_blocks;
+        }
+        bit = (bit | 31) + 1;
+    }
+    return bitmap_blocks;
+}
+
+/* first used bit at or after 'bit' (bitmap_blocks if none); skips empty words */
+static uint32_t bitmap_next_used(uint32_t bit) {
+    while (bit < bitmap_blocks) {
+        uint32_t used_bits = bitmap[bit / 32] >> (bit & 31);
+        if (used_bits) {
+            bit += (uint32_t)__builtin_ctz(used_bits);
+            return bit < bitmap_blocks ? bit : bitmap_blocks;
+        }
+        bit = (bit | 31) + 1;
+    }
+    return bitmap_blocks;
+}
+
+/* find a contiguous run of free blocks of length 'needed' and return starting LBA, 0 on failure */
+static uint32_t bitmap_find_range(uint32_t needed) {
+    if (needed == 0 || needed > bitmap_blocks) return 0;
+    uint32_t bit = 0;
+    while (bit < bitmap_blocks) {
+        uint32_t start = bitmap_next_free(bit);
+        if (start >= bitmap_blocks) break;
+        uint32_t end = bitmap_next_used(start);
+        if (end - start >= needed) return FS_DATA_LBA + start;
+        bit = end;
+    }
+    return 0;
+}
+
+/* set/clear 'count' bits of 'map' starting at block_lba, whole words at a
+   time where possible, and note the sectors touched in *dirty */
+static int bits_set_range(uint32_t *map, uint32_t *dirty, uint32_t block_lba,
+                          uint32_t count, int value) {
+    if (block_lba < FS_DATA_LBA) return -1;
+    uint32_t bit = block_lba - FS_DATA_LBA;
+    if (bit >= bitmap_blocks || count > bitmap_blocks - bit) return -1;
+    uint32_t end = bit + count;
+    while (bit < end) {
+        uint32_t w = bit / 32;
+        uint32_t off = bit & 31;
+        uint32_t n = 32 - off;
+        if (n > end - bit) n = end - bit;
+        uint32_t mask = (n == 32) ? 0xFFFFFFFFu : (((1u << n) - 1) << off);
+        if (value) map[w] |= mask;
+        else map[w] &= ~mask;
+        *dirty |= 1u << (w * 4 / FS_SECTOR);
+        bit += n;
+    }
+    return 0;
+}
+
+static int bitmap_set_range(uint32_t block_lba, uint32_t count, int value) {
+    return bits_set_range(bitmap, &bitmap_dirty, block_lba, count, value);
+}
+
+/* release blocks that committed metadata may still reference on disk;
+   they become free at the end of the next fs_sync */
+static void bitmap_free_later(uint32_t block_lba, uint32_t count) {
+    bits_set_range(bitmap_freed, &freed_dirty, block_lba, count, 1);
+}
+
+/* clear the deferred frees out of the bitmap, marking its sectors dirty */
+static void bitmap_apply_frees(void) {
+    const uint32_t words = FS_SECTOR / 4;
+    for (uint32_t s = 0; s < FS_BITMAP_SECTS; s++) {
+        if (!(freed_dirty & (1u << s))) continue;
+        for (uint32_t w = s * words; w < (s + 1) * words; w++) {
+            bitmap[w] &= ~bitmap_freed[w];
+            bitmap_freed[w] = 0;
+        }
+        bitmap_dirty |= 1u << s;
+    }
+    freed_dirty = 0;
+}
+
+/* ---------- Extent allocation ---------- */
+
+/* allocate 'needed' blocks as at most 'max' extents. One contiguous run is
+   preferred; when free space is fragmented, free runs are taken first-fit.
+   Returns the extent count, or -1 when space or extent slots run out. */
+static int extent_alloc(uint32_t needed, fs_extent_t *out, int max) {
+    if (needed == 0) return 0;
+    if (max <= 0) return -1;
+    uint32_t lba = bitmap_find_range(needed);
+    if (lba) {
+        out[0].start = lba;
+        out[0].count = needed;
+        bitmap_set_range(lba, needed, 1);
+        return 1;
+    }
+    int n = 0;
+    uint32_t bit = 0;
+    uint32_t left = needed;
+    while (left > 0) {
+        if (n == max) return -1;
+        uint32_t start = bitmap_next_free(bit);
+        if (start >= bitmap_blocks) return -1;
+        uint32_t end = bitmap_next_used(start);
+        uint32_t take = end - start;
+        if (take > left) take = left;
+        out[n].start = FS_DATA_LBA + start;
+        out[n].count = take;
+        n++;
+        left -= take;
+        bit = end;
+    }
+    for (int i = 0; i < n; i++) bitmap_set_range(out[i].start, out[i].count, 1);
+    return n;
+}
+
+static uint32_t extents_blocks(const fs_extent_t *ext, int n) {
+    uint32_t total = 0;
+    for (int i = 0; i < n; i++) total += ext[i].count;
+    return total;
+}
+
+/* shorten ext[0..n) to exactly 'keep' blocks; returns the new extent count */
+static int extents_truncate(fs_extent_t *ext, int n, uint32_t keep) {
+    int i = 0;
+    for (; i < n && keep > 0; i++) {
+        if (ext[i].count > keep) ext[i].count = keep;
+        keep -= ext[i].count;
+    }
+    return i;
+}
+
+/* release every block of ext[0..n) past the first 'keep' blocks */
+static void extents_release_from(const fs_extent_t *ext, int n, uint32_t keep) {
+    for (int i = 0; i < n; i++) {
+        if (keep >= ext[i].count) { keep -= ext[i].count; continue; }
+        bitmap_free_later(ext[i].start + keep, ext[i].count - keep);
+        keep = 0;
+    }
+}
+
+/* ---------- In-memory root directory + name hash ----------
+   The root directory is read once at mount time. Lookups hash the name
+   into a bucket chain so open/write/remove never touch the disk; changes
+   are written back one directory sector at a time. */
+#define FS_DIRENTS_PER_SECT (FS_SECTOR / sizeof(fs_dirent_t))
+#define FS_DIR_SLOTS        (FS_ROOT_SECTS * FS_DIRENTS_PER_SECT)
+#define FS_DIR_HASH         64 /* buckets, power of two */
+
+static fs_dirent_t dir_ents[FS_DIR_SLOTS];
+static int16_t dir_hash_head[FS_DIR_HASH];
+static int16_t dir_hash_next[FS_DIR_SLOTS];
+static int dir_used_count;
+static fs_dir_stats_t dir_stats;
+
+/* FNV-1a over the (at most FS_FILENAME_MAX byte) name */
+static uint32_t dir_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < FS_FILENAME_MAX && name[i]; i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619u;
+    }
+    return h & (FS_DIR_HASH - 1);
+}
+
+static void dir_hash_insert(int idx) {
+    uint32_t h = dir_hash(dir_ents[idx].name);
+    dir_hash_next[idx] = dir_hash_head[h];
+    dir_hash_head[h] = (int16_t)idx;
+}
+
+static void dir_hash_unlink(int idx) {
+    int16_t *link = &dir_hash_head[dir_hash(dir_ents[idx].name)];
+    while (*link >= 0) {
+        if (*link == idx) { *link = dir_hash_next[idx]; return; }
+        link = &dir_hash_next[*link];
+    }
+}
+
+static int dir_load(void) {
+    for (int b = 0; b < FS_DIR_HASH; b++) dir_hash_head[b] = -1;
+    dir_used_count = 0;
+    for (uint32_t s = 0; s < FS_ROOT_SECTS; s++) {
+        if (read_sector(FS_ROOT_LBA + s, sector_buf) != 0) return -1;
+        kmemcpy(&dir_ents[s * FS_DIRENTS_PER_SECT], sector_buf,
+                     FS_DIRENTS_PER_SECT * sizeof(fs_dirent_t));
+    }
+    for (int i = 0; i < (int)FS_DIR_SLOTS; i++) {
+        dir_hash_next[i] = -1;
+        if (!dir_ents[i].used) continue;
+        dir_hash_insert(i);
+        dir_used_count++;
+    }
+    return 0;
+}
+
+/* write the directory sector holding entry 'idx' back through the cache,
+   with 'ent' in place of dir_ents[idx]; dir_ents itself is not touched,
+   so a caller commits its staged entry only once this succeeded */
+static int dir_store_as(int idx, const fs_dirent_t *ent) {
+    uint32_t s = (uint32_t)idx / FS_DIRENTS_PER_SECT;
+    kmemset(sector_buf, 0, FS_SECTOR);
+    kmemcpy(sector_buf, &dir_ents[s * FS_DIRENTS_PER_SECT],
+                 FS_DIRENTS_PER_SECT * sizeof(fs_dirent_t));
+    kmemcpy(sector_buf + (idx % FS_DIRENTS_PER_SECT) * sizeof(fs_dirent_t), ent,
+                 sizeof(fs_dirent_t));
+    return write_sector(FS_ROOT_LBA + s, sector_buf);
+}
+
+/* ---------- Open file handles ----------
+   A handle caches the file's extent list so fs_pread can map an offset to
+   LBAs without touching the directory again. Handles follow the file
+   through rewrites and go stale when it is removed. Handles are objects
+   of the "fs_file" cache; the descriptor table only holds pointers. */
+#define FS_MAX_OPEN 8
+
+typedef struct {
+    uint8_t stale;
+    uint8_t unsynced; /* a change made through it failed to sync; fs_close retries */
+    int flags;
+    int slot;      /* index into dir_ents */
+    uint32_t size;
+    int nextents;
+    fs_extent_t ext[FS_MAX_EXTENTS];
+} fs_file_t;
+
+static fs_file_t *open_files[FS_MAX_OPEN];
+static kmem_cache_t *file_cache;
+
+static fs_file_t *handle_get(int fd) {
+    if (fd < 0 || fd >= FS_MAX_OPEN || !open_files[fd]) return 0;
+    if (open_files[fd]->stale) return 0;
+    return open_files[fd];
 }
 
 /* load superblock; if invalid, return -1 */
 int fs_init(void) {
+    TRACE_SCOPE(TRACE_FS_INIT, 0);
     if (read_sector(FS_SUPER_LBA, sector_buf) != 0) return -1;
-    memcpy_small(&superblock, sector_buf, sizeof(fs_super_t));
+    kmemcpy(&superblock, sector_buf, sizeof(fs_super_t));
     if (superblock.magic != FS_MAGIC) {
         fs_ready = 0;
         return -1;
     }
+    if (superblock.version != FS_VERSION || superblock.data_lba != FS_DATA_LBA) {
+        /* older layout (e.g. v1 contiguous files): needs a fresh mkfs */
+        fs_ready = 0;
+        return -2;
+    }
+    if (bitmap_load() != 0) return -1;
+    if (dir_load() != 0) return -1;
+    if (!file_cache) file_cache = kmem_cache_create("fs_file", sizeof(fs_file_t), 0);
+    /* handles from a previous mount no longer describe anything */
+    for (int fd = 0; fd < FS_MAX_OPEN; fd++) {
+        if (open_files[fd]) kmem_cache_free(file_cache, open_files[fd]);
+        open_files[fd] = 0;
+    }
     fs_ready = 1;
     return 0;
 }
 
+/* write back the bitmap and all dirty metadata in the sector cache, in an
+   order that never leaves the disk with a live entry over free blocks:
+   allocations first, then indirect blocks, then the directory, and only
+   then the blocks it stopped using. A failed step stops the sync; the
+   deferred frees stay allocated until a later sync gets through. */
+int fs_sync(void) {
+    TRACE_SCOPE(TRACE_FS_SYNC, 0);
+    if (bitmap_sync() != 0) return -1;
+    if (bcache_flush_range(FS_DATA_LBA, 0xFFFFFFFFu - FS_DATA_LBA) != 0) return -1;
+    if (bcache_flush_range(FS_ROOT_LBA, FS_ROOT_SECTS) != 0) return -1;
+    bitmap_apply_frees();
+    if (bitmap_sync() != 0) return -1;
+    return bcache_flush();
+}
+
 /* internal: find dir entry index, or -1 if not found */
 static int dir_find(const char *name, fs_dirent_t *out) {
-    uint32_t lba = FS_ROOT_LBA;
-    for (int s = 0; s < FS_ROOT_SECTS; s++) {
-        if (read_sector(lba + s, sector_buf) != 0) return -1;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        int entries = 512 / sizeof(fs_dirent_t);
-        for (int i = 0; i < entries; i++) {
-            if (ents[i].used) {
-                if (strncmp_small(ents[i].name, name, FS_FILENAME_MAX) == 0) {
-                    if (out) memcpy_small(out, &ents[i], sizeof(fs_dirent_t));
-                    return (s * entries + i);
-                }
-            }
+    dir_stats.lookups++;
+    for (int i = dir_hash_head[dir_hash(name)]; i >= 0; i = dir_hash_next[i]) {
+        dir_stats.probes++;
+        if (strncmp_small(dir_ents[i].name, name, FS_FILENAME_MAX) == 0) {
+            if (out) kmemcpy(out, &dir_ents[i], sizeof(fs_dirent_t));
+            dir_stats.hits++;
+            return i;
         }
     }
+    dir_stats.misses++;
     return -1;
 }
 
+void fs_get_dir_stats(fs_dir_stats_t *out) {
+    if (out) *out = dir_stats;
+}
+
 /* list directory */
 int fs_list(void) {
+    TRACE_SCOPE(TRACE_FS_LIST, 0);
     if (!fs_ready) return -1;
-    uint32_t lba = FS_ROOT_LBA;
     /* print header once */
     printf_k("filename\t|\tsize\n");
-    for (int s = 0; s < FS_ROOT_SECTS; s++) {
-        if (read_sector(lba + s, sector_buf) != 0) return -1;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        int entries = 512 / sizeof(fs_dirent_t);
-        for (int i = 0; i < entries; i++) {
-            if (ents[i].used) {
-                printf_col("%s\t|\t%u bytes\n", ents[i].name, ents[i].size);
-            }
+    for (int i = 0; i < (int)FS_DIR_SLOTS; i++) {
+        if (dir_ents[i].used) {
+            printf_col("%s\t|\t%u bytes\n", dir_ents[i].name, dir_ents[i].size);
         }
     }
     return 0;
 }
 
 /* helper: find free dir slot and return its global index; -1 if none */
-/* helper: find free dir slot and return its sector LBA and index; -1 if none */
-static int dir_find_free_slot(uint32_t *out_lba_sector, int *out_index) {
-    uint32_t lba = FS_ROOT_LBA;
-    for (int s = 0; s < FS_ROOT_SECTS; s++) {
-        if (read_sector(lba + s, sector_buf) != 0) return -1;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        int entries = 512 / sizeof(fs_dirent_t);
-        for (int i = 0; i < entries; i++) {
-            if (!ents[i].used) {
-                if (out_lba_sector) *out_lba_sector = lba + s;
-                if (out_index) *out_index = i;
-                return 0;
-            }
-        }
+static int dir_find_free_slot(void) {
+    if (dir_used_count >= (int)FS_DIR_SLOTS) return -1;
+    for (int i = 0; i < (int)FS_DIR_SLOTS; i++) {
+        if (!dir_ents[i].used) return i;
     }
     return -1;
 }
 
-/* find free block by scanning bitmap; return LBA of free block, or 0 on error */
-/* find a contiguous run of free blocks of length 'needed' and return starting LBA, 0 on failure */
-static uint32_t bitmap_find_range(uint32_t needed) {
-    if (needed == 0) return 0;
-    /* scan bitmap bit-by-bit for a contiguous run */
-    uint32_t total_bits = FS_BITMAP_SECTS * 512 * 8;
-    uint32_t run = 0;
-    uint32_t start_bit = 0;
-    /* read sectors as needed */
-    for (uint32_t bit_index = 0; bit_index < total_bits; bit_index++) {
-        uint32_t byte_index = bit_index / 8;
-        uint32_t sector = FS_BITMAP_LBA + (byte_index / 512);
-        uint32_t offset = byte_index % 512;
-        if (read_sector(sector, sector_buf) != 0) return 0;
-        uint8_t b = sector_buf[offset];
-        uint8_t bit = 1 << (bit_index % 8);
-        int is_used = (b & bit) != 0;
-        if (!is_used) {
-            if (run == 0) start_bit = bit_index;
-            run++;
-            if (run >= needed) {
-                /* convert start_bit to LBA */
-                uint32_t lba = FS_DATA_LBA + start_bit;
-                return lba;
-            }
-        } else {
-            run = 0;
+/* gather the full extent list of 'd' into ext[]; returns the count or -1 */
+static int dirent_get_extents(const fs_dirent_t *d, fs_extent_t *ext) {
+    int n = d->nextents;
+    if (n > FS_MAX_EXTENTS) return -1;
+    for (int i = 0; i < n && i < FS_INLINE_EXTENTS; i++) ext[i] = d->ext[i];
+    if (n > FS_INLINE_EXTENTS) {
+        if (d->indirect == 0 || read_sector(d->indirect, sector_buf) != 0) return -1;
+        kmemcpy(&ext[FS_INLINE_EXTENTS], sector_buf,
+                     (n - FS_INLINE_EXTENTS) * sizeof(fs_extent_t));
+    }
+    return n;
+}
+
+/* free an indirect extent block (0: none) */
+static void indirect_release(uint32_t lba) {
+    if (lba == 0) return;
+    bitmap_free_later(lba, 1);
+    /* the block may be reused for raw file data; forget the cached copy */
+    bcache_invalidate(lba, 1);
+}
+
+/* store ext[0..n) into the staged entry 'd'. An overflow list always goes
+   to a freshly allocated indirect block, never over the one the committed
+   entry still points at; that old block (0 if none) is handed back in
+   *old_indirect for the caller to release once 'd' is committed. On
+   failure 'd' is unchanged and nothing stays allocated. */
+static int dirent_set_extents(fs_dirent_t *d, const fs_extent_t *ext, int n,
+                              uint32_t *old_indirect) {
+    if (n > FS_MAX_EXTENTS) return -1;
+    uint32_t lba = 0;
+    if (n > FS_INLINE_EXTENTS) {
+        lba = bitmap_find_range(1);
+        if (lba == 0) return -1;
+        bitmap_set_range(lba, 1, 1);
+        kmemset(sector_buf, 0, FS_SECTOR);
+        kmemcpy(sector_buf, &ext[FS_INLINE_EXTENTS],
+                     (n - FS_INLINE_EXTENTS) * sizeof(fs_extent_t));
+        if (write_sector(lba, sector_buf) != 0) {
+            indirect_release(lba);
+            return -1;
         }
     }
+    *old_indirect = d->indirect;
+    d->indirect = lba;
+    kmemset(d->ext, 0, sizeof(d->ext));
+    for (int i = 0; i < n && i < FS_INLINE_EXTENTS; i++) d->ext[i] = ext[i];
+    d->nextents = (uint8_t)n;
     return 0;
 }
 
-/* set/clear a bit in bitmap */
-static int bitmap_set_block(uint32_t block_lba, int value) {
-    if (block_lba < FS_DATA_LBA) return -1;
-    uint32_t bit_index = block_lba - FS_DATA_LBA;
-    uint32_t byte_index = bit_index / 8;
-    uint32_t bit = bit_index % 8;
-    uint32_t sector = FS_BITMAP_LBA + (byte_index / 512);
-    uint32_t offset = byte_index % 512;
-    if (read_sector(sector, sector_buf) != 0) return -1;
-    if (value)
-        sector_buf[offset] |= (1 << bit);
-    else
-        sector_buf[offset] &= ~(1 << bit);
-    if (write_sector(sector, sector_buf) != 0) return -1;
-    return 0;
+/* reload (or invalidate) every handle open on directory slot 'slot' */
+static void handles_refresh(int slot) {
+    for (int fd = 0; fd < FS_MAX_OPEN; fd++) {
+        fs_file_t *f = open_files[fd];
+        if (!f || f->stale || f->slot != slot) continue;
+        int n = dir_ents[slot].used ? dirent_get_extents(&dir_ents[slot], f->ext) : -1;
+        if (n < 0) { f->stale = 1; continue; }
+        f->nextents = n;
+        f->size = dir_ents[slot].size;
+    }
 }
 
-/* helper write file data into blocks (simple: allocate continuous blocks) */
+/* write 'size' bytes into one extent's run of blocks starting at
+   'start_lba'. Whole blocks go out in one multi-sector transfer; only the
+   partial tail block is staged through a bounce buffer to zero its
+   padding. */
 static int write_data_contiguous(uint32_t start_lba, const uint8_t *data, uint32_t size) {
-    uint32_t blocks = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-    for (uint32_t b = 0; b < blocks; b++) {
+    uint32_t full = size / FS_BLOCK_SIZE;
+    uint32_t tail = size % FS_BLOCK_SIZE;
+    if (full > 0 && write_sectors(start_lba, full, data) != 0) return -1;
+    if (tail > 0) {
         uint8_t tmp[512];
-        uint32_t copy = (size > (b+1)*FS_BLOCK_SIZE) ? FS_BLOCK_SIZE : (size - b*FS_BLOCK_SIZE);
-        if (copy > 0) {
-            memcpy_small(tmp, data + b * FS_BLOCK_SIZE, copy);
-        } else {
-            /* nothing to copy - zero the block */
-        }
-        if (copy < FS_BLOCK_SIZE) memset_small(tmp + copy, 0, FS_BLOCK_SIZE - copy);
-        if (write_sector(start_lba + b, tmp) != 0) return -1;
+        kmemcpy(tmp, data + full * FS_BLOCK_SIZE, tail);
+        kmemset(tmp + tail, 0, FS_BLOCK_SIZE - tail);
+        if (write_sectors(start_lba + full, 1, tmp) != 0) return -1;
     }
     return 0;
 }
 
-/* create or overwrite a file */
-int fs_write_file(const char *name, const void *data, int size) {
-    if (!fs_ready) return -1;
-    if (!name || name[0] == 0) return -1;
-    if (strlen_small(name) >= FS_FILENAME_MAX) return -1;
-
-    /* check existing */
-    fs_dirent_t existing;
-    int idx = dir_find(name, &existing);
-    /* if existing found, we'll update its directory entry later; do not free its blocks yet
-       - freeing is done only after a successful relocation to avoid data loss on failures */
-    (void)existing;
+/* spread 'size' bytes over an extent list: one multi-sector request per extent */
+static int write_data_extents(const fs_extent_t *ext, int n, const uint8_t *data, uint32_t size) {
+    for (int i = 0; i < n && size > 0; i++) {
+        uint32_t bytes = ext[i].count * FS_BLOCK_SIZE;
+        if (bytes > size) bytes = size;
+        if (write_data_contiguous(ext[i].start, data, bytes) != 0) return -1;
+        data += bytes;
+        size -= bytes;
+    }
+    return size == 0 ? 0 : -1;
+}
 
-    uint32_t needed = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+/* find the extent holding file block 'block'; returns its index (n if past the end)
+   and the block offset inside it */
+static int extent_locate(const fs_extent_t *ext, int n, uint32_t block, uint32_t *offset) {
+    for (int i = 0; i < n; i++) {
+        if (block < ext[i].count) { *offset = block; return i; }
+        block -= ext[i].count;
+    }
+    *offset = 0;
+    return n;
+}
 
-    /* attempt to reuse existing region if it fits and is still free/owned */
-    uint32_t new_start = 0;
-    if (idx >= 0) {
-        uint32_t old_blocks = (existing.size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-        if (old_blocks >= needed) {
-            /* reuse same start if it has enough blocks (we keep them allocated) */
-            new_start = existing.start_block;
+/* read 'len' bytes at byte offset 'off' of the file described by ext[0..n).
+   Runs of whole sectors inside one extent are fetched with a single
+   multi-sector request straight into 'buf'; only unaligned head/tail
+   pieces go through a bounce buffer. */
+static int read_range(const fs_extent_t *ext, int n, uint32_t off, uint8_t *buf, uint32_t len) {
+    uint32_t b;
+    int i = extent_locate(ext, n, off / FS_BLOCK_SIZE, &b);
+    uint32_t within = off % FS_BLOCK_SIZE;
+    while (len > 0) {
+        if (i >= n) return -1;
+        uint32_t lba = ext[i].start + b;
+        uint32_t step;
+        if (within != 0 || len < FS_BLOCK_SIZE) {
+            uint8_t tmp[512];
+            if (read_sectors(lba, 1, tmp) != 0) return -1;
+            step = FS_BLOCK_SIZE - within;
+            if (step > len) step = len;
+            kmemcpy(buf, tmp + within, step);
+            within = 0;
+            b++;
+        } else {
+            uint32_t blocks = ext[i].count - b;
+            if (blocks > len / FS_BLOCK_SIZE) blocks = len / FS_BLOCK_SIZE;
+            if (read_sectors(lba, blocks, buf) != 0) return -1;
+            step = blocks * FS_BLOCK_SIZE;
+            b += blocks;
         }
+        buf += step;
+        len -= step;
+        if (b >= ext[i].count) { i++; b = 0; }
     }
+    return 0;
+}
 
-    if (new_start == 0) {
-        /* find a contiguous run */
-        new_start = bitmap_find_range(needed);
-        if (new_start == 0) return -1;
-        /* mark new blocks allocated */
-        for (uint32_t k = 0; k < needed; k++) {
-            if (bitmap_set_block(new_start + k, 1) != 0) {
-                /* on failure, roll back previous allocations */
-                for (uint32_t j = 0; j < k; j++) bitmap_set_block(new_start + j, 0);
-                return -1;
+/* write 'len' bytes at byte offset 'off' of ext[0..n). A NULL 'src' writes
+   zeros. Whole sectors are written directly; a partial sector is merged
+   with its old contents, except that anything at or past 'valid' (the
+   file's previous end) is never read back and is zeroed instead. */
+static int write_range(const fs_extent_t *ext, int n, uint32_t off, const uint8_t *src,
+                       uint32_t len, uint32_t valid) {
+    uint32_t b;
+    int i = extent_locate(ext, n, off / FS_BLOCK_SIZE, &b);
+    uint32_t within = off % FS_BLOCK_SIZE;
+    uint32_t pos = off - within; /* file offset of the current sector */
+    while (len > 0) {
+        if (i >= n) return -1;
+        uint32_t lba = ext[i].start + b;
+        uint32_t step;
+        if (within != 0 || len < FS_BLOCK_SIZE || !src) {
+            uint8_t tmp[512];
+            if (pos < valid) {
+                if (read_sectors(lba, 1, tmp) != 0) return -1;
+                if (valid - pos < FS_BLOCK_SIZE)
+                    kmemset(tmp + (valid - pos), 0, FS_BLOCK_SIZE - (valid - pos));
+            } else {
+                kmemset(tmp, 0, FS_BLOCK_SIZE);
             }
+            step = FS_BLOCK_SIZE - within;
+            if (step > len) step = len;
+            if (src) kmemcpy(tmp + within, src, step);
+            else kmemset(tmp + within, 0, step);
+            if (write_sectors(lba, 1, tmp) != 0) return -1;
+            within = 0;
+            b++;
+        } else {
+            uint32_t blocks = ext[i].count - b;
+            if (blocks > len / FS_BLOCK_SIZE) blocks = len / FS_BLOCK_SIZE;
+            if (write_sectors(lba, blocks, src) != 0) return -1;
+            step = blocks * FS_BLOCK_SIZE;
+            b += blocks;
         }
+        if (src) src += step;
+        pos += FS_BLOCK_SIZE * ((step + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE);
+        len -= step;
+        if (b >= ext[i].count) { i++; b = 0; }
     }
+    return 0;
+}
 
-    /* write data */
-    if (write_data_contiguous(new_start, (const uint8_t*)data, size) != 0) {
-        /* on failure, if we allocated new blocks, free them */
-        if (new_start != existing.start_block) {
-            uint32_t allocated = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-            for (uint32_t k = 0; k < allocated; k++) bitmap_set_block(new_start + k, 0);
+/* grow ext[0..*n) to 'needed' blocks. The last extent is stretched over
+   free blocks that directly follow it, the rest comes from new extents.
+   Only when the extent slots run out is the file moved to a freshly
+   allocated list: its first 'size' bytes are copied across and the old
+   list is left in old[0..*old_n) for the caller to release after commit.
+   Returns 0 on success, -1 on failure (ext[] is then unchanged). */
+static int extents_grow(fs_extent_t *ext, int *n, uint32_t needed, uint32_t size,
+                        fs_extent_t *old, int *old_n) {
+    uint32_t have = extents_blocks(ext, *n);
+    *old_n = 0;
+    if (needed <= have) return 0;
+    uint32_t more = needed - have;
+
+    uint32_t stretched = 0;
+    if (*n > 0) {
+        fs_extent_t *last = &ext[*n - 1];
+        uint32_t bit = last->start + last->count - FS_DATA_LBA;
+        if (bit < bitmap_blocks && bitmap_next_free(bit) == bit) {
+            stretched = bitmap_next_used(bit) - bit;
+            if (stretched > more) stretched = more;
+            bitmap_set_range(last->start + last->count, stretched, 1);
+            last->count += stretched;
+            more -= stretched;
         }
-        return -1;
     }
+    if (more == 0) return 0;
 
-    /* write or update dir entry */
-    uint32_t entries_per_sector = 512 / sizeof(fs_dirent_t);
-    if (idx >= 0) {
-        uint32_t sector = FS_ROOT_LBA + (idx / entries_per_sector);
-        if (read_sector(sector, sector_buf) != 0) return -1;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        int local_i = idx % entries_per_sector;
-        strncpy_small(ents[local_i].name, name, FS_FILENAME_MAX);
-        ents[local_i].start_block = new_start;
-        ents[local_i].size = size;
-        ents[local_i].used = 1;
-        if (write_sector(sector, sector_buf) != 0) return -1;
-        /* free old blocks if we moved */
-        if (existing.start_block != 0 && existing.start_block != new_start) {
-            uint32_t old_blocks = (existing.size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-            for (uint32_t b = 0; b < old_blocks; b++) bitmap_set_block(existing.start_block + b, 0);
+    int k = extent_alloc(more, &ext[*n], FS_MAX_EXTENTS - *n);
+    if (k >= 0) { *n += k; return 0; }
+
+    /* undo the stretch and relocate the whole file */
+    if (stretched) {
+        fs_extent_t *last = &ext[*n - 1];
+        last->count -= stretched;
+        bitmap_set_range(last->start + last->count, stretched, 0);
+    }
+    fs_extent_t fresh[FS_MAX_EXTENTS];
+    int fresh_n = extent_alloc(needed, fresh, FS_MAX_EXTENTS);
+    if (fresh_n < 0) return -1;
+    uint8_t chunk[8 * 512];
+    uint32_t copy = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE * FS_BLOCK_SIZE;
+    for (uint32_t pos = 0; pos < copy; pos += sizeof(chunk)) {
+        uint32_t len = copy - pos;
+        if (len > sizeof(chunk)) len = sizeof(chunk);
+        if (read_range(ext, *n, pos, chunk, len) != 0 ||
+            write_range(fresh, fresh_n, pos, chunk, len, 0xFFFFFFFFu) != 0) {
+            extents_release_from(fresh, fresh_n, 0);
+            return -1;
         }
-    } else {
-        uint32_t dir_lba;
-        int dir_index;
-        if (dir_find_free_slot(&dir_lba, &dir_index) != 0) return -1;
-        if (read_sector(dir_lba, sector_buf) != 0) return -1;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        strncpy_small(ents[dir_index].name, name, FS_FILENAME_MAX);
-        ents[dir_index].start_block = new_start;
-        ents[dir_index].size = size;
-        ents[dir_index].used = 1;
-        if (write_sector(dir_lba, sector_buf) != 0) return -1;
     }
+    for (int i = 0; i < *n; i++) old[i] = ext[i];
+    *old_n = *n;
+    for (int i = 0; i < fresh_n; i++) ext[i] = fresh[i];
+    *n = fresh_n;
     return 0;
 }
 
-/* run a binary file by loading it into an execution buffer and calling it.
-   This assumes binaries are position-independent flat code suitable for direct call. */
-/* Minimal ELF loader: supports ELF32 PT_LOAD segments by sliding into a run buffer.
-   This is NOT a full ELF loader (no relocations, no dynamic linking). It expects
-   relatively small, position-independent or relocatable test programs.
-*/
-int fs_run(const char *name) {
+/* create or overwrite a file */
+int fs_write_file(const char *name, const void *data, int size) {
+    TRACE_SCOPE(TRACE_FS_WRITE_FILE, size);
     if (!fs_ready) return -1;
     if (!name || name[0] == 0) return -1;
-    fs_dirent_t d;
-    if (dir_find(name, &d) < 0) return -1;
-    if (d.size == 0) return -1;
-
-    enum { RUN_BUF_SIZE = 65536 };
-    static uint8_t file_buf[RUN_BUF_SIZE];
-    static uint8_t run_buf[RUN_BUF_SIZE];
-    if ((uint32_t)d.size > RUN_BUF_SIZE) return -1;
-    int r = fs_read_file(name, file_buf, RUN_BUF_SIZE);
-    if (r < 0) return -1;
-
-    /* ELF32 structures */
-    typedef struct {
-        unsigned char e_ident[16];
-        uint16_t e_type;
-        uint16_t e_machine;
-        uint32_t e_version;
-        uint32_t e_entry;
-        uint32_t e_phoff;
-        uint32_t e_shoff;
-        uint32_t e_flags;
-        uint16_t e_ehsize;
-        uint16_t e_phentsize;
-        uint16_t e_phnum;
-        uint16_t e_shentsize;
-        uint16_t e_shnum;
-        uint16_t e_shstrndx;
-    } __attribute__((packed)) Elf32_Ehdr;
-
-    typedef struct {
-        uint32_t p_type;
-        uint32_t p_offset;
-        uint32_t p_vaddr;
-        uint32_t p_paddr;
-        uint32_t p_filesz;
-        uint32_t p_memsz;
-        uint32_t p_flags;
-        uint32_t p_align;
-    } __attribute__((packed)) Elf32_Phdr;
-
-    if ((uint32_t)r < sizeof(Elf32_Ehdr)) return -1;
-    Elf32_Ehdr *eh = (Elf32_Ehdr*)file_buf;
-    /* check ELF magic */
-    if (!(eh->e_ident[0] == 0x7f && eh->e_ident[1] == 'E' && eh->e_ident[2] == 'L' && eh->e_ident[3] == 'F')) {
-        /* not ELF - treat as flat binary: copy into run_buf and call */
-        memcpy_small(run_buf, file_buf, r);
-        void (*entry_flat)(void) = (void(*)(void))run_buf;
-        entry_flat();
-        return 0;
-    }
-    /* only support 32-bit little-endian here */
-    if (eh->e_ident[4] != 1) return -1; /* ELFCLASS32 */
-
-    uint32_t phoff = eh->e_phoff;
-    uint16_t phnum = eh->e_phnum;
-    uint16_t phentsize = eh->e_phentsize;
-    if (phoff + (uint32_t)phnum * phentsize > (uint32_t)r) return -1;
-
-    uint32_t min_vaddr = 0xFFFFFFFFu;
-    uint32_t max_vaddr = 0;
-    for (uint16_t i = 0; i < phnum; i++) {
-        uint32_t off = phoff + i * phentsize;
-        if (off + sizeof(Elf32_Phdr) > (uint32_t)r) return -1;
-        Elf32_Phdr ph;
-        memcpy_small(&ph, file_buf + off, sizeof(Elf32_Phdr));
-        if (ph.p_type != 1) continue; /* PT_LOAD */
-        if (ph.p_memsz == 0) continue;
-        if (ph.p_vaddr < min_vaddr) min_vaddr = ph.p_vaddr;
-        uint32_t end = ph.p_vaddr + ph.p_memsz;
-        if (end > max_vaddr) max_vaddr = end;
-    }
-    if (min_vaddr == 0xFFFFFFFFu) return -1; /* no loadable segments */
-
-    uint32_t total_size = max_vaddr - min_vaddr;
-    if (total_size > RUN_BUF_SIZE) return -1;
-
-    /* zero run buffer then copy segments from file_buf into run_buf (non-overlapping) */
-    memset_small(run_buf, 0, total_size);
-    for (uint16_t i = 0; i < phnum; i++) {
-        uint32_t off = phoff + i * phentsize;
-        Elf32_Phdr ph;
-        memcpy_small(&ph, file_buf + off, sizeof(Elf32_Phdr));
-        if (ph.p_type != 1) continue;
-        if (ph.p_filesz > 0) {
-            if (ph.p_offset + ph.p_filesz > (uint32_t)r) return -1;
-            uint32_t dest = ph.p_vaddr - min_vaddr;
-            memcpy_small(run_buf + dest, file_buf + ph.p_offset, ph.p_filesz);
-        }
-        /* remaining p_memsz already zeroed */
+    if (size < 0) return -1;
+    if (strlen_small(name) >= FS_FILENAME_MAX) return -1;
+
+    uint32_t needed = ((uint32_t)size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    fs_extent_t old_ext[FS_MAX_EXTENTS];
+    fs_extent_t new_ext[FS_MAX_EXTENTS] = {{0, 0}};
+    int old_n = 0;
+    int new_n;
+
+    /* work on a copy of the entry; it is committed only once the data is on disk */
+    fs_dirent_t ent;
+    int idx = dir_find(name, &ent);
+    int slot = idx;
+    if (idx >= 0) {
+        old_n = dirent_get_extents(&ent, old_ext);
+        if (old_n < 0) return -1;
+    } else {
+        slot = dir_find_free_slot();
+        if (slot < 0) return -1;
+        kmemset(&ent, 0, sizeof(ent));
+        strncpy_small(ent.name, name, FS_FILENAME_MAX);
+        ent.used = 1;
     }
 
-    uint32_t entry = eh->e_entry;
-    if (entry < min_vaddr || entry >= max_vaddr) return -1;
-    uint32_t entry_off = entry - min_vaddr;
-    void (*entry_point)(void) = (void(*)(void))(run_buf + entry_off);
-    entry_point();
-    return 0;
+    /* overwrite in place when the old blocks suffice, otherwise allocate a
+       fresh extent list (from as many free runs as it takes) and free the
+       old one only after the new data is safely written */
+    int reuse = (idx >= 0 && extents_blocks(old_ext, old_n) >= needed);
+    if (reuse) {
+        for (int i = 0; i < old_n; i++) new_ext[i] = old_ext[i];
+        new_n = extents_truncate(new_ext, old_n, needed);
+    } else {
+        new_n = extent_alloc(needed, new_ext, FS_MAX_EXTENTS);
+        if (new_n < 0) return -1;
+    }
+
+    uint32_t old_indirect;
+    if (write_data_extents(new_ext, new_n, (const uint8_t*)data, size) != 0 ||
+        dirent_set_extents(&ent, new_ext, new_n, &old_indirect) != 0) {
+        if (!reuse) extents_release_from(new_ext, new_n, 0);
+        return -1;
+    }
+    ent.size = size;
+
+    /* the directory still describes the old file until this write lands */
+    if (dir_store_as(slot, &ent) != 0) {
+        indirect_release(ent.indirect);
+        if (!reuse) extents_release_from(new_ext, new_n, 0);
+        return -1;
+    }
+    dir_ents[slot] = ent;
+    if (idx < 0) {
+        dir_hash_insert(slot);
+        dir_used_count++;
+    }
+
+    /* release whatever the file no longer uses */
+    indirect_release(old_indirect);
+    extents_release_from(old_ext, old_n, reuse ? needed : 0);
+    handles_refresh(slot);
+    return fs_sync();
 }
 
 /* read file contents into buf up to bufsize */
 int fs_read_file(const char *name, void *buf, int bufsize) {
+    TRACE_SCOPE(TRACE_FS_READ_FILE, bufsize);
     if (!fs_ready) return -1;
+    if (bufsize < 0) return -1;
     fs_dirent_t d;
     if (dir_find(name, &d) < 0) return -1;
+    fs_extent_t ext[FS_MAX_EXTENTS];
+    int n = dirent_get_extents(&d, ext);
+    if (n < 0) return -1;
     uint32_t toread = d.size;
     if ((uint32_t)bufsize < toread) toread = bufsize;
-    uint32_t blocks = (toread + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-    uint8_t tmp[512];
-    for (uint32_t b = 0; b < blocks; b++) {
-        if (read_sector(d.start_block + b, tmp) != 0) return -1;
-        uint32_t copy = (toread > 512) ? 512 : toread;
-        memcpy_small((uint8_t*)buf + b * 512, tmp, copy);
-        toread -= copy;
+    if (read_range(ext, n, 0, (uint8_t*)buf, toread) != 0) return -1;
+    return (int)toread;
+}
+
+/* open a file; FS_O_CREATE makes an empty one if it does not exist and
+   FS_O_TRUNC cuts an existing one to zero length. Returns a small
+   descriptor or -1; -1 means the directory is unchanged. If the change
+   could not be synced the descriptor is still returned and fs_close
+   reports the error */
+int fs_open(const char *name, int flags) {
+    TRACE_SCOPE(TRACE_FS_OPEN, flags);
+    if (!fs_ready) return -1;
+    if (!name || name[0] == 0) return -1;
+    if (!(flags & (FS_O_READ | FS_O_WRITE))) return -1;
+    if ((flags & (FS_O_CREATE | FS_O_TRUNC)) && !(flags & FS_O_WRITE)) return -1;
+
+    int fd = 0;
+    while (fd < FS_MAX_OPEN && open_files[fd]) fd++;
+    if (fd == FS_MAX_OPEN) return -1;
+    /* take the handle first: once the directory changes, the open succeeds */
+    fs_file_t *f = (fs_file_t*)kmem_cache_alloc(file_cache);
+    if (!f) return -1;
+    f->unsynced = 0;
+
+    int slot = dir_find(name, 0);
+    if (slot < 0) {
+        if (!(flags & FS_O_CREATE) || strlen_small(name) >= FS_FILENAME_MAX ||
+            (slot = dir_find_free_slot()) < 0) {
+            kmem_cache_free(file_cache, f);
+            return -1;
+        }
+        fs_dirent_t ent;
+        kmemset(&ent, 0, sizeof(ent));
+        strncpy_small(ent.name, name, FS_FILENAME_MAX);
+        ent.used = 1;
+        if (dir_store_as(slot, &ent) != 0) { kmem_cache_free(file_cache, f); return -1; }
+        dir_ents[slot] = ent;
+        dir_hash_insert(slot);
+        dir_used_count++;
+        f->unsynced = fs_sync() != 0;
+    } else if ((flags & FS_O_TRUNC) && dir_ents[slot].size > 0) {
+        fs_extent_t ext[FS_MAX_EXTENTS];
+        int n = dirent_get_extents(&dir_ents[slot], ext);
+        fs_dirent_t ent = dir_ents[slot];
+        uint32_t old_indirect;
+        ent.size = 0;
+        if (n < 0 || dirent_set_extents(&ent, ext, 0, &old_indirect) != 0 ||
+            dir_store_as(slot, &ent) != 0) {
+            kmem_cache_free(file_cache, f);
+            return -1;
+        }
+        dir_ents[slot] = ent;
+        indirect_release(old_indirect);
+        extents_release_from(ext, n, 0);
+        handles_refresh(slot);
+        f->unsynced = fs_sync() != 0;
     }
-    return (int)((d.size < (uint32_t)bufsize) ? d.size : bufsize);
+
+    int n = dirent_get_extents(&dir_ents[slot], f->ext);
+    if (n < 0) { kmem_cache_free(file_cache, f); return -1; }
+    open_files[fd] = f;
+    f->stale = 0;
+    f->flags = flags;
+    f->slot = slot;
+    f->nextents = n;
+    f->size = dir_ents[slot].size;
+    return fd;
+}
+
+/* read up to 'len' bytes at byte offset 'off'; returns bytes read (0 at EOF) or -1 */
+int fs_pread(int fd, uint32_t off, void *buf, uint32_t len) {
+    TRACE_SCOPE(TRACE_FS_PREAD, len);
+    fs_file_t *f = handle_get(fd);
+    if (!f || !buf || !(f->flags & FS_O_READ)) return -1;
+    if (off >= f->size) return 0;
+    if (len > f->size - off) len = f->size - off;
+    if (len > 0x7FFFFFFFu) len = 0x7FFFFFFFu;
+    if (read_range(f->ext, f->nextents, off, (uint8_t*)buf, len) != 0) return -1;
+    return (int)len;
+}
+
+/* write 'len' bytes at byte offset 'off', touching only the sectors the
+   range covers. Writing past the end grows the file (a gap is zero-filled);
+   returns bytes written or -1, which leaves the file as it was. A sync
+   failure after the write took effect is reported by fs_close */
+int fs_pwrite(int fd, uint32_t off, const void *buf, uint32_t len) {
+    TRACE_SCOPE(TRACE_FS_PWRITE, len);
+    fs_file_t *f = handle_get(fd);
+    if (!f || !buf || !(f->flags & FS_O_WRITE)) return -1;
+    if (len == 0) return 0;
+    if (len > 0x7FFFFFFFu || off > 0x7FFFFFFFu - len) return -1;
+
+    uint32_t end = off + len;
+    uint32_t new_size = end > f->size ? end : f->size;
+    uint32_t needed = (new_size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    uint32_t had = extents_blocks(f->ext, f->nextents);
+
+    fs_extent_t ext[FS_MAX_EXTENTS];
+    fs_extent_t old_ext[FS_MAX_EXTENTS];
+    int n = f->nextents;
+    int old_n;
+    for (int i = 0; i < n; i++) ext[i] = f->ext[i];
+    if (extents_grow(ext, &n, needed, f->size, old_ext, &old_n) != 0) return -1;
+
+    uint32_t valid = f->size;
+    int rc = 0;
+    if (off > valid) {
+        rc = write_range(ext, n, valid, 0, off - valid, valid);
+        valid = off;
+    }
+    if (rc == 0) rc = write_range(ext, n, off, (const uint8_t*)buf, len, valid);
+
+    int moved = (needed > had);
+    if (rc == 0 && new_size != f->size) {
+        fs_dirent_t ent = dir_ents[f->slot];
+        uint32_t old_indirect = 0;
+        if (moved) rc = dirent_set_extents(&ent, ext, n, &old_indirect);
+        ent.size = new_size;
+        if (rc == 0) {
+            /* commit only once the directory sector is written */
+            rc = dir_store_as(f->slot, &ent);
+            if (rc == 0) {
+                dir_ents[f->slot] = ent;
+                indirect_release(old_indirect);
+            } else if (moved) {
+                indirect_release(ent.indirect); /* fresh from dirent_set_extents */
+            }
+        }
+    }
+    if (rc != 0) {
+        /* give back whatever this call allocated */
+        if (old_n) extents_release_from(ext, n, 0);
+        else if (moved) extents_release_from(ext, n, had);
+        return -1;
+    }
+    if (old_n) extents_release_from(old_ext, old_n, 0);
+    if (new_size != f->size) {
+        handles_refresh(f->slot);
+        /* the write has taken effect; a sync failure surfaces at fs_close */
+        if (fs_sync() != 0) f->unsynced = 1;
+    }
+    return (int)len;
+}
+
+/* write at the current end of file */
+int fs_append(int fd, const void *buf, uint32_t len) {
+    fs_file_t *f = handle_get(fd);
+    if (!f) return -1;
+    return fs_pwrite(fd, f->size, buf, len);
+}
+
+/* current size in bytes of an open file, or -1 */
+int fs_fsize(int fd) {
+    fs_file_t *f = handle_get(fd);
+    return f ? (int)f->size : -1;
+}
+
+/* close a descriptor; -1 if a change made through it is still not on
+   disk after one more fs_sync */
+int fs_close(int fd) {
+    TRACE_SCOPE(TRACE_FS_CLOSE, fd);
+    if (fd < 0 || fd >= FS_MAX_OPEN || !open_files[fd]) return -1;
+    int rc = (open_files[fd]->unsynced && fs_sync() != 0) ? -1 : 0;
+    kmem_cache_free(file_cache, open_files[fd]);
+    open_files[fd] = 0;
+    return rc;
 }
 
 /* remove file (free dir entry + bitmap) */
 int fs_remove(const char *name) {
+    TRACE_SCOPE(TRACE_FS_REMOVE, 0);
     if (!fs_ready) return -1;
-    fs_dirent_t ent;
-    int idx = dir_find(name, &ent);
+    int idx = dir_find(name, 0);
     if (idx < 0) return -1;
-    uint32_t blocks = (ent.size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
-    for (uint32_t b = 0; b < blocks; b++) bitmap_set_block(ent.start_block + b, 0);
-    uint32_t entries_per_sector = 512 / sizeof(fs_dirent_t);
-    uint32_t sector = FS_ROOT_LBA + (idx / entries_per_sector);
-    if (read_sector(sector, sector_buf) != 0) return -1;
-    fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-    int local_i = idx % entries_per_sector;
-    memset_small(&ents[local_i], 0, sizeof(fs_dirent_t));
-    if (write_sector(sector, sector_buf) != 0) return -1;
-    return 0;
+    fs_extent_t ext[FS_MAX_EXTENTS];
+    int n = dirent_get_extents(&dir_ents[idx], ext);
+    if (n < 0) return -1;
+    /* nothing in memory changes unless the empty entry made it into the
+       sector cache; the blocks are released through bitmap_free_later, so
+       fs_sync writes the entry before any bitmap sector that frees them */
+    fs_dirent_t ent;
+    kmemset(&ent, 0, sizeof(ent));
+    if (dir_store_as(idx, &ent) != 0) return -1;
+    uint32_t old_indirect = dir_ents[idx].indirect;
+    dir_hash_unlink(idx);
+    dir_ents[idx] = ent;
+    dir_used_count--;
+    indirect_release(old_indirect);
+    extents_release_from(ext, n, 0);
+    handles_refresh(idx);
+    return fs_sync();
 }
 
 /* count files in root directory (simple helper) */
 int fs_count_files(void) {
     if (!fs_ready) return 0;
-    int count = 0;
-    uint32_t lba = FS_ROOT_LBA;
-    for (int s = 0; s < FS_ROOT_SECTS; s++) {
-        if (read_sector(lba + s, sector_buf) != 0) return count;
-        fs_dirent_t *ents = (fs_dirent_t*)sector_buf;
-        int entries = 512 / sizeof(fs_dirent_t);
-        for (int i = 0; i < entries; i++) if (ents[i].used) count++;
-    }
-    return count;
+    return dir_used_count;
 }
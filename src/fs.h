@@ -2,8 +2,21 @@
 #define FS_H
 #include <stdint.h>
 
-#define FS_MAGIC 0x42494E4F /* 'BINO' */
-#define FS_SECTOR 512
+#include "fs_format.h"
+
+/* root directory name-index counters */
+typedef struct {
+    uint32_t lookups;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t probes; /* entries compared while walking hash chains */
+} fs_dir_stats_t;
+
+/* fs_open flags */
+#define FS_O_READ   0x1
+#define FS_O_WRITE  0x2
+#define FS_O_CREATE 0x4  /* create the file if it does not exist */
+#define FS_O_TRUNC  0x8  /* discard existing contents */
 
 int fs_init(void);
 int fs_format_hostimage(const char *imgpath); /* host utility uses mkfs, not in kernel */
@@ -11,7 +24,14 @@ int fs_list(void);
 int fs_read_file(const char *name, void *buf, int bufsize);
 int fs_write_file(const char *name, const void *data, int size);
 int fs_remove(const char *name);
-int fs_run(const char *name);
 int fs_count_files(void);
+int fs_sync(void);
+int fs_open(const char *name, int flags);
+int fs_pread(int fd, uint32_t off, void *buf, uint32_t len);
+int fs_pwrite(int fd, uint32_t off, const void *buf, uint32_t len);
+int fs_append(int fd, const void *buf, uint32_t len);
+int fs_fsize(int fd);
+int fs_close(int fd);
+void fs_get_dir_stats(fs_dir_stats_t *out);
 
 #endif
@@ -0,0 +1,264 @@
+/* fs_bench.c - host benchmark for the filesystem.
+   Links the kernel's fs.c and bcache.c unchanged against ata_host.c and
+   runs a set of workloads on a freshly formatted image, reporting
+   operations per second and the sectors / ATA commands each operation
+   costs. Build with `make fs_bench`; run as
+       output/fs_bench [image-path] [seed]
+   The exit status is non-zero if any filesystem call failed.
+*/
+
+#include "fs.h"
+#include "ata.h"
+#include "ata_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SECTORS   (FS_DATA_LBA + FS_BITMAP_SECTS * FS_SECTOR * 8) /* whole bitmap range */
+#define BENCH_FILES     100
+#define BENCH_FILE_SIZE 8192
+#define BENCH_PREADS    2000
+#define BENCH_APPENDS   2000
+#define BENCH_CHURN     3000
+#define BENCH_CHURN_MAX (64 * 1024)
+#define BENCH_LOOKUPS   2000
+
+static uint8_t buf[BENCH_CHURN_MAX];
+static uint8_t rbuf[BENCH_CHURN_MAX];
+static uint32_t rng_state;
+static int failures;
+
+static uint32_t rng(void) {
+    /* xorshift32 */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void check(int ok, const char *what, const char *name) {
+    if (ok) return;
+    if (failures++ < 10) fprintf(stderr, "fs_bench: %s failed (%s)\n", what, name);
+}
+
+static void fill(uint8_t *p, uint32_t len, uint32_t seed) {
+    for (uint32_t i = 0; i < len; i++) p[i] = (uint8_t)(seed * 31 + i);
+}
+
+/* contents unique to one file and one write of it, so blocks read back
+   from the wrong extent or a stale copy do not compare equal */
+static void fill_tagged(uint8_t *p, uint32_t len, uint32_t file, uint32_t gen) {
+    uint32_t x = file * 2654435761u ^ gen * 40503u ^ 0x9E3779B9u;
+    for (uint32_t i = 0; i < len; i++) {
+        if ((i & 3) == 0) x = x * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(x >> ((i & 3) * 8));
+    }
+}
+
+typedef struct {
+    struct timespec t0;
+    ata_host_stats_t io0;
+} phase_t;
+
+static void phase_begin(phase_t *p) {
+    ata_host_get_stats(&p->io0);
+    clock_gettime(CLOCK_MONOTONIC, &p->t0);
+}
+
+static void phase_end(phase_t *p, const char *name, uint32_t ops) {
+    struct timespec t1;
+    ata_host_stats_t io;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ata_host_get_stats(&io);
+    double secs = (t1.tv_sec - p->t0.tv_sec) + (t1.tv_nsec - p->t0.tv_nsec) / 1e9;
+    double n = ops ? ops : 1;
+    printf("%-12s %7u %12.0f %9.2f %9.2f %9.2f\n", name, ops,
+           secs > 0 ? ops / secs : 0.0,
+           (io.sectors_read - p->io0.sectors_read) / n,
+           (io.sectors_written - p->io0.sectors_written) / n,
+           ((io.read_cmds - p->io0.read_cmds) + (io.write_cmds - p->io0.write_cmds)) / n);
+}
+
+static void name_of(char *out, const char *prefix, int i) {
+    snprintf(out, FS_FILENAME_MAX, "%s%03d", prefix, i);
+}
+
+/* create, overwrite, read, pread, append and remove on BENCH_FILES files */
+static void bench_basic(void) {
+    phase_t ph;
+    char name[FS_FILENAME_MAX];
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        name_of(name, "f", i);
+        fill(buf, BENCH_FILE_SIZE, i);
+        check(fs_write_file(name, buf, BENCH_FILE_SIZE) == 0, "create", name);
+    }
+    phase_end(&ph, "create", BENCH_FILES);
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        name_of(name, "f", i);
+        fill(buf, BENCH_FILE_SIZE, i + 1000);
+        check(fs_write_file(name, buf, BENCH_FILE_SIZE) == 0, "overwrite", name);
+    }
+    phase_end(&ph, "overwrite", BENCH_FILES);
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        name_of(name, "f", i);
+        fill(buf, BENCH_FILE_SIZE, i + 1000);
+        int n = fs_read_file(name, rbuf, BENCH_FILE_SIZE);
+        check(n == BENCH_FILE_SIZE && memcmp(buf, rbuf, BENCH_FILE_SIZE) == 0, "read", name);
+    }
+    phase_end(&ph, "read", BENCH_FILES);
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_PREADS; i++) {
+        int f = (int)(rng() % BENCH_FILES);
+        uint32_t off = rng() % (BENCH_FILE_SIZE - 100);
+        name_of(name, "f", f);
+        int fd = fs_open(name, FS_O_READ);
+        check(fd >= 0 && fs_pread(fd, off, rbuf, 100) == 100, "pread", name);
+        fill(buf, BENCH_FILE_SIZE, f + 1000);
+        check(memcmp(buf + off, rbuf, 100) == 0, "pread data", name);
+        if (fd >= 0) fs_close(fd);
+    }
+    phase_end(&ph, "open+pread", BENCH_PREADS);
+
+    int fd = fs_open("log", FS_O_WRITE | FS_O_CREATE | FS_O_TRUNC);
+    check(fd >= 0, "open log", "log");
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_APPENDS && fd >= 0; i++) {
+        char line[81];
+        int n = snprintf(line, sizeof(line), "%05d %-73s\n", i, "log line");
+        check(fs_append(fd, line, (uint32_t)n) == n, "append", "log");
+    }
+    phase_end(&ph, "append", BENCH_APPENDS);
+    if (fd >= 0) fs_close(fd);
+    check(fs_remove("log") == 0, "remove", "log");
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_FILES; i++) {
+        name_of(name, "f", i);
+        check(fs_remove(name) == 0, "remove", name);
+    }
+    phase_end(&ph, "remove", BENCH_FILES);
+}
+
+/* random creates and removes of 1 B .. 64 KB files so free space fragments */
+static void bench_churn(void) {
+    static uint32_t sizes[BENCH_FILES];
+    static uint32_t gens[BENCH_FILES];
+    phase_t ph;
+    char name[FS_FILENAME_MAX];
+    memset(sizes, 0, sizeof(sizes));
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_CHURN; i++) {
+        int f = (int)(rng() % BENCH_FILES);
+        name_of(name, "c", f);
+        if (sizes[f] && (rng() & 1)) {
+            check(fs_remove(name) == 0, "churn remove", name);
+            sizes[f] = 0;
+        } else {
+            uint32_t len = 1 + rng() % BENCH_CHURN_MAX;
+            fill_tagged(buf, len, (uint32_t)f, (uint32_t)i);
+            check(fs_write_file(name, buf, (int)len) == 0, "churn write", name);
+            sizes[f] = len;
+            gens[f] = (uint32_t)i;
+        }
+    }
+    phase_end(&ph, "churn", BENCH_CHURN);
+
+    /* every file must still hold exactly what was last written to it */
+    for (int f = 0; f < BENCH_FILES; f++) {
+        if (!sizes[f]) continue;
+        name_of(name, "c", f);
+        fill_tagged(buf, sizes[f], (uint32_t)f, gens[f]);
+        check(fs_read_file(name, rbuf, BENCH_CHURN_MAX) == (int)sizes[f] &&
+              memcmp(buf, rbuf, sizes[f]) == 0, "churn verify", name);
+        check(fs_remove(name) == 0, "churn cleanup", name);
+    }
+}
+
+/* fill the root directory, then look names up (hits and misses) */
+static void bench_full_dir(void) {
+    phase_t ph;
+    char name[FS_FILENAME_MAX];
+    int created = 0;
+    fill(buf, 100, 7);
+
+    phase_begin(&ph);
+    for (int i = 0; i < FS_MAX_FILES; i++) {
+        name_of(name, "d", i);
+        if (fs_write_file(name, buf, 100) != 0) break;
+        created++;
+    }
+    phase_end(&ph, "dir fill", (uint32_t)created);
+    check(created == FS_MAX_FILES, "dir fill", "root");
+    if (!created) return;
+    name_of(name, "d", FS_MAX_FILES);
+    check(fs_write_file(name, buf, 100) < 0, "full dir rejects create", name);
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        name_of(name, "d", (int)(rng() % created));
+        int fd = fs_open(name, FS_O_READ);
+        check(fd >= 0, "lookup", name);
+        if (fd >= 0) fs_close(fd);
+    }
+    phase_end(&ph, "lookup hit", BENCH_LOOKUPS);
+
+    phase_begin(&ph);
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        name_of(name, "x", (int)(rng() % 1000));
+        check(fs_open(name, FS_O_READ) < 0, "lookup miss", name);
+    }
+    phase_end(&ph, "lookup miss", BENCH_LOOKUPS);
+
+    phase_begin(&ph);
+    for (int i = 0; i < created; i++) {
+        name_of(name, "d", i);
+        check(fs_remove(name) == 0, "dir remove", name);
+    }
+    phase_end(&ph, "dir empty", (uint32_t)created);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "fs_bench.img";
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 12345;
+    if (!rng_state) rng_state = 1;
+
+    if (ata_host_create(path, BENCH_SECTORS) != 0) {
+        perror(path);
+        return 2;
+    }
+    /* same layout mkfs writes: a superblock, the rest zero */
+    fs_super_t sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.magic = FS_MAGIC;
+    sb.version = FS_VERSION;
+    sb.total_sectors = BENCH_SECTORS;
+    sb.data_lba = FS_DATA_LBA;
+    ata_write_sector(FS_SUPER_LBA, (const uint8_t*)&sb);
+    if (fs_init() != 0) {
+        fprintf(stderr, "fs_bench: mount failed\n");
+        return 2;
+    }
+    ata_host_reset_stats();
+
+    printf("%-12s %7s %12s %9s %9s %9s\n", "workload", "ops", "ops/sec", "rd/op", "wr/op", "cmds/op");
+    bench_basic();
+    bench_churn();
+    bench_full_dir();
+
+    check(fs_sync() == 0, "sync", path);
+    ata_host_close();
+    unlink(path);
+    if (failures) fprintf(stderr, "fs_bench: %d failed operations\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+/* fs_format.h - on-disk layout of the tiny filesystem.
+   Shared by the kernel (fs.c) and the host tools (mkfs.c, put.c) so the
+   three can never disagree about where things live.
+
+   LBA 0                 unused (boot sector)
+   LBA 1                 superblock
+   LBA 2 .. 17           block bitmap, bit i = data block FS_DATA_LBA + i
+   LBA 18 .. 33          root directory, FS_MAX_FILES 64-byte entries
+   LBA 34 ..             data blocks (file data and indirect extent blocks)
+*/
+#ifndef FS_FORMAT_H
+#define FS_FORMAT_H
+
+#include <stdint.h>
+
+#define FS_MAGIC 0x42494E4F /* 'BINO' */
+#define FS_VERSION 2        /* v2: extent lists instead of one contiguous run */
+#define FS_SECTOR 512
+
+#define FS_SUPER_LBA    1
+#define FS_BITMAP_LBA   2
+#define FS_BITMAP_SECTS 16
+#define FS_ROOT_LBA     (FS_BITMAP_LBA + FS_BITMAP_SECTS)
+#define FS_ROOT_SECTS   16
+#define FS_DATA_LBA     (FS_ROOT_LBA + FS_ROOT_SECTS)
+
+#define FS_MAX_FILES    128
+#define FS_FILENAME_MAX 32
+#define FS_BLOCK_SIZE   512
+
+/* superblock structure (stored in LBA 1) */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_sectors;
+    uint32_t data_lba;
+    uint8_t  reserved[512 - 16];
+} __attribute__((packed)) fs_super_t;
+
+/* a run of 'count' consecutive data blocks starting at LBA 'start' */
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+} __attribute__((packed)) fs_extent_t;
+
+#define FS_INLINE_EXTENTS   2
+#define FS_INDIRECT_EXTENTS (FS_SECTOR / 8) /* extents held by one indirect block */
+#define FS_MAX_EXTENTS      (FS_INLINE_EXTENTS + FS_INDIRECT_EXTENTS)
+
+/* directory entry: the first FS_INLINE_EXTENTS extents live inline, the
+   rest in a single indirect block at 'indirect' (0 when unused) */
+typedef struct {
+    char name[FS_FILENAME_MAX];
+    uint32_t size;        /* in bytes */
+    uint8_t used;
+    uint8_t nextents;     /* total extents, inline + indirect */
+    uint16_t reserved;
+    uint32_t indirect;    /* LBA of indirect extent block */
+    fs_extent_t ext[FS_INLINE_EXTENTS];
+    uint32_t pad;
+} __attribute__((packed)) fs_dirent_t;
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <stdarg.h>
 #include <stdint.h>
+#include "kformat.h"
 
 /* ---------- small types for freestanding build ---------- */
 typedef unsigned int uint;
@@ -108,66 +109,13 @@ static void fn_puts(const char *s) {
     for (uint i = 0; s && s[i]; i++) fn_putc(s[i]);
 }
 
-/* ---------- tiny integer -> string helpers ---------- */
-static void utoa(unsigned int v, char *out, int base) {
-    char buf[33];
-    int p = 0;
-    if (v == 0) { out[0] = '0'; out[1] = 0; return; }
-    while (v) {
-        int d = v % base;
-        buf[p++] = (d < 10) ? ('0' + d) : ('a' + (d - 10));
-        v /= base;
-    }
-    /* reverse */
-    int j = 0;
-    while (p--) out[j++] = buf[p];
-    out[j] = 0;
-}
-
-/* ---------- minimal vsnprintf + printf (global) ---------- */
-static int fn_vsnprintf(char *buf, int bufsize, const char *fmt, va_list ap) {
-    int p = 0;
-    for (int i = 0; fmt[i] && p < bufsize - 1; i++) {
-        if (fmt[i] == '%') {
-            i++;
-            char tmp[64];
-            if (fmt[i] == 's') {
-                char *s = va_arg(ap, char*);
-                for (int k = 0; s && s[k] && p < bufsize - 1; k++) buf[p++] = s[k];
-            } else if (fmt[i] == 'd' || fmt[i] == 'u') {
-                int v = va_arg(ap, int);
-                if (fmt[i] == 'd' && v < 0) {
-                    buf[p++] = '-';
-                    v = -v;
-                }
-                utoa((unsigned)v, tmp, 10);
-                for (int k = 0; tmp[k] && p < bufsize - 1; k++) buf[p++] = tmp[k];
-            } else if (fmt[i] == 'x') {
-                unsigned v = va_arg(ap, unsigned);
-                utoa(v, tmp, 16);
-                for (int k = 0; tmp[k] && p < bufsize - 1; k++) buf[p++] = tmp[k];
-            } else if (fmt[i] == 'c') {
-                char c = (char)va_arg(ap, int);
-                buf[p++] = c;
-            } else {
-                /* unknown, print literally */
-                buf[p++] = '%';
-                if (p < bufsize - 1) buf[p++] = fmt[i];
-            }
-        } else {
-            buf[p++] = fmt[i];
-        }
-    }
-    buf[p] = '\0';
-    return p;
-}
-
 /* Global printf used by fs.c and others */
 int printf(const char *fmt, ...) {
     char tmp[512];
     va_list ap;
     va_start(ap, fmt);
-    int n = fn_vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    int n = kvsnprintf(tmp, sizeof(tmp), fmt, ap);
+    if (n > (int)sizeof(tmp) - 1) n = sizeof(tmp) - 1; /* kvsnprintf returns the untruncated length */
     va_end(ap);
     /* output using fn_putc (handles newlines & scroll) */
     for (int i = 0; i < n; i++) fn_putc(tmp[i]);
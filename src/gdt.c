@@ -0,0 +1,100 @@
+/* gdt.c - segment descriptors, the TSS and the SYSENTER MSRs.
+   GRUB leaves its own GDT loaded; this one replaces it with the same
+   kernel selectors (0x08 code, 0x10 data) and adds the ring-3 segments
+   and the TSS.
+*/
+
+#include "gdt.h"
+#include "kstring.h"
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+struct gdt_entry {
+    uint16_t limit_lo;
+    uint16_t base_lo;
+    uint8_t  base_mid;
+    uint8_t  access;
+    uint8_t  gran;
+    uint8_t  base_hi;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+/* 32-bit TSS; only ss0/esp0 and the I/O map base are used */
+struct tss {
+    uint32_t prev, esp0, ss0, esp1, ss1, esp2, ss2, cr3;
+    uint32_t eip, eflags, eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap, iomap;
+} __attribute__((packed));
+
+static struct gdt_entry gdt[6];
+static struct gdt_ptr gdtp;
+static struct tss tss;
+static int sysenter_ok;
+
+extern void sysenter_entry(void); /* isr80.s */
+
+static void gdt_set(int n, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
+    gdt[n].limit_lo = limit & 0xFFFF;
+    gdt[n].base_lo = base & 0xFFFF;
+    gdt[n].base_mid = (base >> 16) & 0xFF;
+    gdt[n].access = access;
+    gdt[n].gran = (uint8_t)((gran & 0xF0) | ((limit >> 16) & 0x0F));
+    gdt[n].base_hi = (base >> 24) & 0xFF;
+}
+
+static inline void wrmsr(uint32_t msr, uint32_t value) {
+    asm volatile ("wrmsr" :: "c"(msr), "a"(value), "d"(0));
+}
+
+void gdt_init(void) {
+    gdt_set(0, 0, 0, 0, 0);
+    gdt_set(1, 0, 0xFFFFF, 0x9A, 0xC0); /* kernel code */
+    gdt_set(2, 0, 0xFFFFF, 0x92, 0xC0); /* kernel data */
+    gdt_set(3, 0, 0xFFFFF, 0xFA, 0xC0); /* user code, DPL 3 */
+    gdt_set(4, 0, 0xFFFFF, 0xF2, 0xC0); /* user data, DPL 3 */
+    kmemset(&tss, 0, sizeof(tss));
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap = sizeof(tss); /* no I/O bitmap: ring 3 gets no ports */
+    gdt_set(5, (uint32_t)(uintptr_t)&tss, sizeof(tss) - 1, 0x89, 0x00);
+
+    gdtp.limit = sizeof(gdt) - 1;
+    gdtp.base = (uint32_t)(uintptr_t)gdt;
+    asm volatile (
+        "lgdtl (%0)\n\t"
+        "ljmp $0x08, $1f\n"
+        "1:\n\t"
+        "movw $0x10, %%ax\n\t"
+        "movw %%ax, %%ds\n\t"
+        "movw %%ax, %%es\n\t"
+        "movw %%ax, %%fs\n\t"
+        "movw %%ax, %%gs\n\t"
+        "movw %%ax, %%ss\n\t"
+        "movw $0x28, %%ax\n\t"
+        "ltr %%ax"
+        :: "r"(&gdtp) : "eax", "memory");
+
+    uint32_t a = 1, b, c = 0, d;
+    asm volatile ("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    /* SEP; family 6 model < 3 with stepping < 3 advertises it falsely */
+    if ((d & (1u << 11)) && !(((a >> 8) & 0xF) == 6 && ((a >> 4) & 0xF) < 3 && (a & 0xF) < 3)) {
+        wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)(uintptr_t)sysenter_entry);
+        sysenter_ok = 1;
+    }
+}
+
+void gdt_set_kernel_stack(uint32_t esp0) {
+    tss.esp0 = esp0;
+    if (sysenter_ok) wrmsr(MSR_SYSENTER_ESP, esp0);
+}
+
+int gdt_has_sysenter(void) {
+    return sysenter_ok;
+}
@@ -0,0 +1,28 @@
+#ifndef GDT_H
+#define GDT_H
+
+#include <stdint.h>
+
+/* Kernel-owned GDT: flat code and data segments for ring 0 and ring 3,
+   plus one TSS whose only job is to name the kernel stack the CPU
+   switches to when ring-3 code traps. The order of the four flat
+   segments is fixed by SYSENTER/SYSEXIT, which derive the other three
+   selectors from GDT_KERNEL_CODE. */
+
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   (0x18 | 3)
+#define GDT_USER_DATA   (0x20 | 3)
+#define GDT_TSS         0x28
+
+/* load the GDT and TSS; also programs the SYSENTER MSRs when the CPU
+   has them */
+void gdt_init(void);
+
+/* kernel stack top for the next trap or SYSENTER from ring 3 */
+void gdt_set_kernel_stack(uint32_t esp0);
+
+/* 1 if SYSENTER/SYSEXIT are available */
+int gdt_has_sysenter(void);
+
+#endif
@@ -19,7 +19,7 @@ get_eip:
     mov eax, 1
     int 0x80
 
-    ; return to caller (fs_run calls entry as a function)
+    ; returning ends the program (the loader leaves an exit stub on the stack)
     ret
 
 section .data
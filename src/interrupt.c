@@ -1,6 +1,10 @@
 #include "interrupt.h"
 #include "io.h"
-#include "vga_mode13.h"
+#include "irq.h"
+#include "vmm.h"
+#include "sched.h"
+#include "elf.h"
+#include "serial.h"
 #include <stdint.h>
 
 /* IDT entry (8 bytes) */
@@ -21,6 +25,8 @@ static struct idt_entry idt[256];
 static struct idt_ptr idtp;
 
 extern void isr80_stub(void);
+extern const uint32_t irq_stubs[16]; /* irq_entry.s */
+extern const uint32_t exc_stubs[32]; /* exc_entry.s */
 
 static void idt_set_gate(int n, uint32_t handler, uint16_t sel, uint8_t flags) {
     idt[n].base_lo = handler & 0xFFFF;
@@ -44,142 +50,51 @@ void idt_init(void) {
         idt[i].flags = 0;
         idt[i].base_hi = 0;
     }
-    /* set syscall vector 0x80, selector 0x08 (kernel code), flags 0x8E (present, DPL=0, 32-bit interrupt gate) */
-    idt_set_gate(0x80, (uint32_t)isr80_stub, 0x08, 0x8E);
+    /* set syscall vector 0x80, selector 0x08 (kernel code), flags 0xEE (present, DPL=3 so ring 3 may
+       raise it, 32-bit interrupt gate) */
+    idt_set_gate(0x80, (uint32_t)isr80_stub, 0x08, 0xEE);
+    /* CPU exceptions */
+    for (int i = 0; i < 32; i++) idt_set_gate(i, exc_stubs[i], 0x08, 0x8E);
+    /* hardware interrupts from the remapped PICs */
+    for (int i = 0; i < 16; i++) idt_set_gate(IRQ_VECTOR_BASE + i, irq_stubs[i], 0x08, 0x8E);
 
     idtp.limit = sizeof(idt) - 1;
     idtp.base = (uint32_t)&idt;
     lidt(&idtp);
 }
 
-/* C handler called from isr80_stub. regs points to saved registers (pushad order). */
-void isr80_handler(uint32_t *regs) {
-     /* The assembly stub uses "pushal" which pushes registers in the
-         following order (memory lowest->highest after the pushes):
-            [0]=EDI, [1]=ESI, [2]=EBP, [3]=ESP (original), [4]=EBX,
-            [5]=EDX, [6]=ECX, [7]=EAX
+static const char *const exc_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range",
+    "invalid opcode", "device not available", "double fault", "coprocessor overrun",
+    "invalid TSS", "segment not present", "stack fault", "general protection",
+    "page fault", "reserved", "x87 error", "alignment check", "machine check",
+    "SIMD error", "virtualization", "control protection",
+};
 
-         We therefore map logical registers (0=EAX,1=ECX,2=EDX,3=EBX,
-         4=ESP,5=EBP,6=ESI,7=EDI) to the fixed indexes above. This is
-         deterministic and removes the previous heuristic rotation which
-         caused incorrect register reads.
-     */
-     /* R(i) returns the logical register: 0->EAX,1->ECX,...,7->EDI */
-     #define R(idx) regs[(7 - (idx))]
-    uint32_t num = R(0);
-    switch (num) {
-        case 1: {
-            /* syscall 1: print NUL-terminated string at EBX */
-            const char *s = (const char*)R(3); /* EBX */
-            if (s) printf_k("%s", s);
-            R(0) = 0; /* return 0 in EAX */
-            break;
-        }
-        case 2: {
-            /* syscall 2: write buffer of length ECX from EBX (not fd-aware) */
-            const char *buf = (const char*)R(3); /* EBX */
-            uint32_t len = R(1); /* ECX */
-            uint32_t written = 0;
-            if (buf && len > 0) {
-                for (uint32_t i = 0; i < len; i++) {
-                    char c = buf[i];
-                    putc_k(c);
-                    written++;
-                }
-            }
-            R(0) = written; /* return number of bytes written */
-            break;
-        }
-        case 3: {
-            /* syscall 3: read a line into buffer at EBX, up to ECX-1 bytes; returns length */
-            char *buf = (char*)R(3); /* EBX */
-            int max = (int)R(1); /* ECX */
-            if (!buf || max <= 0) {
-                regs[0] = 0;
-                break;
-            }
-            int n = readline(buf, max);
-            R(0) = (uint32_t)n;
-            break;
-        }
-        case 4: {
-            /* syscall 4: set color; EBX = fg (0-15), ECX = bg (0-15) */
-            uint32_t fg = R(3);
-            uint32_t bg = R(1);
-            if (fg <= 15 && bg <= 15) vga_set_color((uint8_t)fg, (uint8_t)bg);
-            R(0) = 0;
-            break;
-        }
-        case 5: {
-            /* syscall 5: set cursor position; EBX = x, ECX = y */
-            int x = (int)R(3);
-            int y = (int)R(1);
-            vga_set_cursor(x, y);
-            R(0) = 0;
-            break;
-        }
-        case 6: {
-            /* syscall 6: get cursor position; EBX = ptr to two ints [x,y] */
-            int *out = (int*)R(3);
-            if (out) {
-                int x, y; vga_get_cursor(&x, &y);
-                out[0] = x; out[1] = y;
-                R(0) = 0;
-            } else {
-                R(0) = (uint32_t)-1;
-            }
-            break;
-        }
-        case 7: {
-            /* syscall 7: clear screen */
-            clrscr();
-            R(0) = 0;
-            break;
-        }
-        case 8: {
-            /* syscall 8: switch to VGA mode13 */
-            vga_set_mode13();
-            R(0) = 0;
-            break;
-        }
-        case 9: {
-            /* syscall 9: putpixel in mode13; EBX=x, ECX=y, EDX=color */
-            int x = (int)R(3);
-            int y = (int)R(1);
-            int color = (int)R(2);
-            vga_putpixel(x, y, (uint8_t)color);
-            R(0) = 0;
-            break;
-        }
-        case 10: {
-            /* syscall 10: set default mode13 palette */
-            vga_set_palette_default();
-            R(0) = 0;
-            break;
-        }
-        case 11: {
-            /* syscall 11: clear mode13 with color in EBX */
-            int color = (int)R(3);
-            vga_clear_mode13((uint8_t)color);
-            R(0) = 0;
-            break;
-        }
-        case 12: {
-            /* syscall 12: switch back to text mode */
-            vga_set_text_mode();
-            R(0) = 0;
-            break;
-        }
-        default: {
-            /* Helpful debug: print unsupported syscall number and register snapshot */
-            printf_k("Unknown syscall %u\n", num);
-            printf_k("regs: EAX=%x ECX=%x EDX=%x EBX=%x ESI=%x EDI=%x EBP=%x ESP=%x\n",
-                     R(0), R(1), R(2), R(3), R(6), R(7), R(5), R(4));
-            printf_k("Supported: 1=print,2=write,3=read,4=setcolor,5=setcursor,6=getcursor,7=clear\n");
-            R(0) = (uint32_t)-1;
-            break;
-        }
+void exception_dispatch(exc_frame_t *f) {
+    uint32_t cr2 = 0;
+    if (f->vector == 14) {
+        asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+        if (vmm_page_fault(cr2, f->err) == 0) return;
     }
-    /* cleanup helper macro */
-    #undef R
+    const char *name = exc_names[f->vector & 31] ? exc_names[f->vector & 31] : "reserved";
+    printf_k("\nEXCEPTION %u (%s) err=%#x eip=%#x cs=%#x eflags=%#x\n",
+             f->vector, name, f->err, f->eip, f->cs, f->eflags);
+    printf_k("EAX=%#x EBX=%#x ECX=%#x EDX=%#x ESI=%#x EDI=%#x EBP=%#x CR2=%#x\n",
+             f->eax, f->ebx, f->ecx, f->edx, f->esi, f->edi, f->ebp, cr2);
+    /* the program did it, either directly or by handing a syscall a user
+       address that is not mapped: end the program, not the kernel */
+    int user_addr = f->vector == 14 && cr2 >= USER_BASE && cr2 < USER_LIMIT;
+    if ((f->cs & 3) == 3 || (user_addr && sched_kernel_stack() != 0)) {
+        printf_k("Program terminated.\n");
+        elf_exit(-1);
+    }
+    if (thread_current() != 0) {
+        /* a background thread: drop it and keep the system running */
+        printf_k("Thread %d killed.\n", thread_current());
+        thread_exit();
+    }
+    printf_k("System halted.\n");
+    serial_flush(); /* IRQ4 will not run again */
+    for (;;) asm volatile ("cli; hlt");
 }
@@ -3,13 +3,22 @@
 
 #include <stdint.h>
 
-/* Initialize IDT and syscall handler */
+/* Initialize IDT and syscall handler (see syscall.h) */
 void idt_init(void);
 
-/* C entry called from ISR stub. 'regs' points to pushed registers (pushad order)
-   regs[0] = EAX, regs[1] = ECX, regs[2] = EDX, regs[3] = EBX,
-   regs[4] = ESP, regs[5] = EBP, regs[6] = ESI, regs[7] = EDI
-*/
-void isr80_handler(uint32_t *regs);
+/* stack frame built by exc_entry.s: pushad registers, then the vector and
+   error code (0 when the CPU pushes none), then what the CPU pushed */
+typedef struct {
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
+    uint32_t vector, err;
+    uint32_t eip, cs, eflags;
+} exc_frame_t;
+
+/* C entry called from the exception stubs; page faults go to the VMM.
+   Anything it cannot resolve prints a register dump, then ends the
+   program if ring 3 faulted (or the kernel faulted on a user address on
+   the program's behalf), else the faulting thread, or stops the machine
+   if that is the shell */
+void exception_dispatch(exc_frame_t *f);
 
 #endif
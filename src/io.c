@@ -1,25 +1,32 @@
 // === FILE: io.c ===
 #include "io.h"
 #include "kstring.h" /* custom string helpers */
+#include "kformat.h"
+#include "serial.h"
+#include "trace.h"
 #include "framebuffer.h"
+#include "multiboot.h"
+#include "kmalloc.h"
+#include "irq.h"
+#include "sched.h"
 volatile uint16_t *vga = (volatile uint16_t*)0xB8000;
 int cursor_x = 0, cursor_y = 0;
 static uint8_t vga_attr = VGA_ATTR;
-/* Scrollback by full-screen pages (simple implementation)
- * Each page stores the full 80x25 text buffer so the user can page up/down.
+/* Line-by-line scrollback ring. The live screen is the VGA_HEIGHT lines
+ * starting at live_top, so scrolling advances live_top and blanks the line
+ * that enters at the bottom; whatever leaves the top is already history.
+ * Line numbers run freely and are masked on access.
  */
-/* Line-by-line scrollback buffer */
-#define SCROLL_LINES 1024
+#define SCROLL_LINES 1024 /* power of two */
+#define RING_LINE(n) (scroll_lines[(n) & (SCROLL_LINES - 1)])
 static uint16_t scroll_lines[SCROLL_LINES][VGA_WIDTH];
-static int scroll_next_write = 0; /* next slot to write */
-static int scroll_count_lines = 0; /* total stored (capped at SCROLL_LINES) */
+static uint32_t live_top = 0; /* ring line shown on screen row 0 */
 static int scroll_viewing = 0; /* whether we're currently viewing history */
-static int scroll_view_top = 0; /* index in buffer of line rendered at top of screen */
-static uint16_t saved_live[VGA_WIDTH * VGA_HEIGHT]; /* saved live screen when entering view */
+static uint32_t scroll_view_top = 0; /* ring line rendered at top of screen */
 /* Command-line history */
 #define HISTORY_SIZE 64
 #define HISTORY_LEN 256
-static char history[HISTORY_SIZE][HISTORY_LEN];
+static char *history[HISTORY_SIZE]; /* heap copies, sized to each line */
 static int history_count = 0;
 static int history_next = 0; /* next slot to write */
 /* Keyboard/readline coordination */
@@ -34,136 +41,145 @@ static inline uint8_t inb(uint16_t port) {
     __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
     return ret;
 }
+/* Console output is drawn into the live lines of the scrollback ring. Rows
+ * that change are marked dirty and copied to VRAM a dword at a time by
+ * con_flush(), which the public output calls run once per call (printf_k,
+ * puts_k, ...) and the keyboard runs before it blocks. The CRTC cursor is
+ * only reprogrammed there, and only when it actually moved.
+ */
+static uint32_t con_dirty; /* bit r set => row r differs from VRAM */
+static int con_hw_pos = -1; /* cursor position last sent to the CRTC */
+#define CON_ALL_ROWS ((1u << VGA_HEIGHT) - 1)
+
+/* writable pointer to row r of the live screen; marks the row dirty */
+static inline uint16_t *con_row(int r) {
+    con_dirty |= 1u << r;
+    return RING_LINE(live_top + r);
+}
+static void vga_copy_row(int r, const uint16_t *line) {
+    volatile uint32_t *dst = (volatile uint32_t*)(vga + r * VGA_WIDTH);
+    const uint32_t *src = (const uint32_t*)line;
+    for (int i = 0; i < VGA_WIDTH / 2; i++) dst[i] = src[i];
+}
 static void update_hardware_cursor(void) {
-    unsigned short pos = (unsigned short)(cursor_y * VGA_WIDTH + cursor_x);
+    int pos = cursor_y * VGA_WIDTH + cursor_x;
+    if (pos == con_hw_pos) return;
+    con_hw_pos = pos;
     outb(0x3D4, 0x0F);
     outb(0x3D5, (uint8_t)(pos & 0xFF));
     outb(0x3D4, 0x0E);
     outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
 }
-/* push a completed line (row) into the scrollback ring */
-static void scroll_push_line_from_row(int row) {
-    if (row < 0 || row >= VGA_HEIGHT) return;
-    for (int c = 0; c < VGA_WIDTH; c++) scroll_lines[scroll_next_write][c] = vga[row * VGA_WIDTH + c];
-    scroll_next_write = (scroll_next_write + 1) % SCROLL_LINES;
-    if (scroll_count_lines < SCROLL_LINES) scroll_count_lines++;
-}
-/* push the top-most line being discarded during automatic scroll */
-static void scroll_push_top_line(void) {
-    for (int c = 0; c < VGA_WIDTH; c++) scroll_lines[scroll_next_write][c] = vga[c];
-    scroll_next_write = (scroll_next_write + 1) % SCROLL_LINES;
-    if (scroll_count_lines < SCROLL_LINES) scroll_count_lines++;
-}
-/* render scroll buffer starting at `top_idx` into the screen lines 0..VGA_HEIGHT-1 */
-static void render_scroll_from_index(int top_idx) {
-    int idx = top_idx;
-    for (int r = 0; r < VGA_HEIGHT; r++) {
-        for (int c = 0; c < VGA_WIDTH; c++) {
-            vga[r * VGA_WIDTH + c] = scroll_lines[idx][c];
-        }
-        idx = (idx + 1) % SCROLL_LINES;
+void con_flush(void) {
+    TRACE_SCOPE(TRACE_CON_FLUSH, 0);
+    /* while history is on screen, live changes wait until the view closes */
+    if (scroll_viewing) return;
+    uint32_t dirty = con_dirty;
+    con_dirty = 0;
+    while (dirty) {
+        int r = __builtin_ctz(dirty);
+        dirty &= dirty - 1;
+        vga_copy_row(r, RING_LINE(live_top + r));
     }
+    update_hardware_cursor();
 }
-/* compute index of most recent line in buffer (the newest stored) */
-static int scroll_index_newest(void) {
-    if (scroll_count_lines == 0) return 0;
-    int idx = (scroll_next_write - 1 + SCROLL_LINES) % SCROLL_LINES;
-    return idx;
+/* scroll the live screen by one line and blank the one entering at the bottom */
+static void con_shift_up(uint16_t blank) {
+    live_top++;
+    uint16_t *last = RING_LINE(live_top + VGA_HEIGHT - 1);
+    for (int c = 0; c < VGA_WIDTH; c++) last[c] = blank;
+    con_dirty = CON_ALL_ROWS;
 }
-/* Save live screen to saved_live buffer */
+/* start a blank screen below the used rows, which stay in the scrollback */
+static void con_clear(uint16_t blank) {
+    live_top += cursor_y + (cursor_x > 0);
+    for (int r = 0; r < VGA_HEIGHT; r++) {
+        uint16_t *row = con_row(r);
+        for (int c = 0; c < VGA_WIDTH; c++) row[c] = blank;
+    }
+    cursor_x = 0; cursor_y = 0;
+}
+/* oldest ring line that has not been overwritten yet */
+static uint32_t scroll_oldest(void) {
+    if (live_top + VGA_HEIGHT <= SCROLL_LINES) return 0;
+    return live_top + VGA_HEIGHT - SCROLL_LINES;
+}
+/* render scroll buffer starting at `top_idx` straight to VRAM */
+static void render_scroll_from_index(uint32_t top_idx) {
+    for (int r = 0; r < VGA_HEIGHT; r++) vga_copy_row(r, RING_LINE(top_idx + r));
+    /* draw HISTORY indicator at top-right */
+    const char *hint = "HISTORY";
+    int pos = VGA_WIDTH - 7;
+    for (int i = 0; i < 7; i++) vga[pos + i] = ((uint16_t)vga_attr << 8) | hint[i];
+}
+/* Enter the history view. The live lines stay in the ring, so there is
+ * nothing to copy; con_flush() just stops drawing them. */
 static void save_live_screen(void) {
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) saved_live[i] = vga[i];
+    scroll_viewing = 1;
 }
-/* Restore live screen from saved_live */
+/* Leave the history view and redraw the live screen */
 static void restore_live_screen(void) {
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) vga[i] = saved_live[i];
+    scroll_viewing = 0;
+    con_dirty = CON_ALL_ROWS;
+    con_flush();
+}
+/* move the history view by delta lines (negative = older) */
+static void scroll_view_move(int delta) {
+    uint32_t oldest = scroll_oldest();
+    if (!scroll_viewing) {
+        if (oldest == live_top) return; /* nothing above the screen yet */
+        save_live_screen();
+        scroll_view_top = live_top;
+    }
+    int32_t back = (int32_t)(live_top - scroll_view_top) - delta;
+    int32_t max = (int32_t)(live_top - oldest);
+    if (back > max) back = max;
+    if (back <= 0) { restore_live_screen(); return; }
+    scroll_view_top = live_top - (uint32_t)back;
+    render_scroll_from_index(scroll_view_top);
 }
 void clrscr(void) {
-    uint16_t blank = ((uint16_t)vga_attr << 8) | ' ';
-    /* push each existing line into scrollback */
-    for (int r = 0; r < VGA_HEIGHT; r++) scroll_push_line_from_row(r);
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) vga[i] = blank;
-    cursor_x = 0; cursor_y = 0;
-    update_hardware_cursor();
+    con_clear(((uint16_t)vga_attr << 8) | ' ');
+    con_flush();
 }
 static void scroll_if_needed(void) {
     if (cursor_y < VGA_HEIGHT) return;
-    /* before we overwrite the top line, push it into the scrollback */
-    scroll_push_top_line();
-    for (int r = 1; r < VGA_HEIGHT; r++) {
-        for (int c = 0; c < VGA_WIDTH; c++) {
-            vga[(r-1)*VGA_WIDTH + c] = vga[r*VGA_WIDTH + c];
-        }
-    }
-    /* clear last line */
-    uint16_t blank = ((uint16_t)vga_attr << 8) | ' ';
-    for (int c = 0; c < VGA_WIDTH; c++) vga[(VGA_HEIGHT-1)*VGA_WIDTH + c] = blank;
+    con_shift_up(((uint16_t)vga_attr << 8) | ' ');
     cursor_y = VGA_HEIGHT - 1;
 }
-int putchar_col(int c) {
-    if (c == '\r') { cursor_x = 0; update_hardware_cursor(); return c; }
-    if (c == '\n') { cursor_x = 0; cursor_y++; scroll_if_needed(); update_hardware_cursor(); return c; }
-    if (c == '\t') { int spaces = 4 - (cursor_x % 4); while (spaces--) putchar_col(' '); return c; }
+static int col_putc(int c) {
+    if (c == '\r') { cursor_x = 0; return c; }
+    if (c == '\n') { cursor_x = 0; cursor_y++; scroll_if_needed(); return c; }
+    if (c == '\t') { int spaces = 4 - (cursor_x % 4); while (spaces--) col_putc(' '); return c; }
     if (c == '\b') {
         if (cursor_x == 0 && cursor_y == 0) return c;
         if (cursor_x == 0) { cursor_y--; cursor_x = VGA_WIDTH - 1; }
         else cursor_x--;
-        vga[cursor_y * VGA_WIDTH + cursor_x] = ((uint16_t)vga_attr << 8) | ' ';
-        update_hardware_cursor();
+        con_row(cursor_y)[cursor_x] = ((uint16_t)vga_attr << 8) | ' ';
         return c;
     }
     uint16_t entry = ((uint16_t)vga_attr << 8) | (uint8_t)c;
-    vga[cursor_y * VGA_WIDTH + cursor_x] = entry;
+    con_row(cursor_y)[cursor_x] = entry;
     cursor_x++;
     if (cursor_x >= VGA_WIDTH) { cursor_x = 0; cursor_y++; }
     scroll_if_needed();
-    update_hardware_cursor();
+    return c;
+}
+int putchar_col(int c) {
+    char ch = (char)c;
+    serial_mirror_write(&ch, 1);
+    col_putc(c);
+    con_flush();
     return c;
 }
 void puts_col(const char *s) {
-    for (int i = 0; s && s[i]; i++) putchar_col((int)(uint8_t)s[i]);
-}
-/* tiny uitoa reused here */
-static int uitoa(unsigned int v, char *out, int base) {
-    char tmp[32]; int pos=0;
-    if (v==0) { out[0]='0'; out[1]=0; return 1; }
-    while (v) {
-        int d = v % base; tmp[pos++] = (d < 10) ? ('0'+d) : ('a'+d-10);
-        v /= base;
-    }
-    for (int i=0;i<pos;i++) out[i]=tmp[pos-1-i];
-    out[pos]=0; return pos;
+    if (!s) return;
+    serial_mirror_write(s, (int)kstrlen(s));
+    for (int i = 0; s[i]; i++) col_putc((int)(uint8_t)s[i]);
+    con_flush();
 }
 int vsnprintf_col(char *buf, int bufsz, const char *fmt, va_list ap) {
-    int p=0;
-    for (int i=0; fmt[i] && p < bufsz-1; i++) {
-        if (fmt[i]=='%') {
-            i++;
-            if (fmt[i]=='s') {
-                char *s = va_arg(ap, char*);
-                if (!s) s = "(null)";
-                for (int k=0; s[k] && p<bufsz-1; k++) buf[p++]=s[k];
-            } else if (fmt[i]=='d' || fmt[i]=='u') {
-                int v = va_arg(ap,int);
-                if (fmt[i]=='d' && v<0) { buf[p++]='-'; v=-v; }
-                char t[32]; uitoa((unsigned)v,t,10);
-                for (int k=0;t[k] && p<bufsz-1;k++) buf[p++]=t[k];
-            } else if (fmt[i]=='x') {
-                unsigned v = va_arg(ap,unsigned);
-                char t[32]; uitoa(v,t,16);
-                for (int k=0;t[k] && p<bufsz-1;k++) buf[p++]=t[k];
-            } else if (fmt[i]=='c') {
-                char c = (char)va_arg(ap,int);
-                buf[p++]=c;
-            } else if (fmt[i]=='%') {
-                buf[p++]='%';
-            } else {
-                /* unknown, print it verbatim */
-                buf[p++]='%'; if (fmt[i]) buf[p++]=fmt[i];
-            }
-        } else buf[p++]=fmt[i];
-    }
-    buf[p]=0; return p;
+    return kvsnprintf(buf, bufsz, fmt, ap);
 }
 /* keyboard via BIOS port (polling) - translate basic scancodes */
 void io_init(void) {
@@ -196,23 +212,6 @@ uint32_t strlen(const char* s) {
     while (s[len]) len++;
     return len;
 }
-void* memcpy(void* dest, const void* src, uint32_t n) {
-    uint8_t* d = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
-   
-    for (uint32_t i = 0; i < n; i++) {
-        d[i] = s[i];
-    }
-    return dest;
-}
-void* memset(void* dest, uint8_t val, uint32_t n) {
-    uint8_t* d = (uint8_t*)dest;
-   
-    for (uint32_t i = 0; i < n; i++) {
-        d[i] = val;
-    }
-    return dest;
-}
 /* ===================== ATA PIO ===================== */
 static void ata_wait_bsy(void) {
     while (inb(0x1F7) & 0x80) ;
@@ -247,44 +246,6 @@ int ata_identify(void) {
     // Check if it's an ATA device
     return (buffer[0] & 0x8000) == 0;
 }
-void ata_read_lba28(uint32_t lba, uint8_t sectors, void* buffer) {
-    if (sectors == 0) return;
-   
-    ata_wait_bsy();
-    outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(0x1F2, sectors);
-    outb(0x1F3, (uint8_t)lba);
-    outb(0x1F4, (uint8_t)(lba >> 8));
-    outb(0x1F5, (uint8_t)(lba >> 16));
-    outb(0x1F7, 0x20); // READ SECTORS
-   
-    uint8_t* buf = (uint8_t*)buffer;
-    for (int s = 0; s < sectors; s++) {
-        ata_wait_drq();
-        insw(0x1F0, buf + s * 512, 256);
-    }
-}
-void ata_write_lba28(uint32_t lba, uint8_t sectors, const void* buffer) {
-    if (sectors == 0) return;
-   
-    ata_wait_bsy();
-    outb(0x1F6, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(0x1F2, sectors);
-    outb(0x1F3, (uint8_t)lba);
-    outb(0x1F4, (uint8_t)(lba >> 8));
-    outb(0x1F5, (uint8_t)(lba >> 16));
-    outb(0x1F7, 0x30); // WRITE SECTORS
-   
-    const uint8_t* buf = (const uint8_t*)buffer;
-    for (int s = 0; s < sectors; s++) {
-        ata_wait_drq();
-        outsw(0x1F0, buf + s * 512, 256);
-    }
-   
-    // Flush cache
-    outb(0x1F7, 0xE7);
-    ata_wait_bsy();
-}
 /* ===================== VGA Text Mode ===================== */
 /*volatile uint16_t* vga = (volatile uint16_t*)0xB8000;
 static int cursor_x = 0, cursor_y = 0;
@@ -298,11 +259,8 @@ void vga_init(void) {
     vga_set_color(COLOR_LIGHT_GRAY, COLOR_BLACK);
 }
 void vga_clear(void) {
-    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
-        vga[i] = (current_color << 8) | ' ';
-    }
-    cursor_x = 0;
-    cursor_y = 0;
+    con_clear((current_color << 8) | ' ');
+    con_flush();
 }
 void vga_set_color(uint8_t fg, uint8_t bg) {
     current_color = (bg << 4) | fg;
@@ -336,10 +294,8 @@ void fb_init(uint32_t magic, uint32_t addr) {
      * 'vbe_control_info' fields from the multiboot info structure if present.
      * If we find a plausible physical framebuffer pointer we keep it.
      */
-    uint32_t *mb = (uint32_t*)(uintptr_t)addr;
-    /* mb[16] = vbe_control_info, mb[17] = vbe_mode (per our earlier typedef) */
-    uint32_t vbe_ctrl = mb[16];
-    uint32_t vbe_mode = mb[17];
+    const multiboot_info_t *mb = (const multiboot_info_t*)(uintptr_t)addr;
+    uint32_t vbe_ctrl = mb->vbe_control_info;
     if (vbe_ctrl == 0) return;
     uint8_t *ctrl = (uint8_t*)(uintptr_t)vbe_ctrl;
     uint32_t phys = 0;
@@ -381,6 +337,25 @@ void fb_clear(uint32_t color) {
         for (uint32_t x = 0; x < shim_fb_w; x++) fb_putpixel(x, y, color);
     }
 }
+int fb_blit(uint32_t x, uint32_t y, uint32_t w, uint32_t h, const uint32_t *src, uint32_t pitch) {
+    if (!shim_fb_ok || x >= shim_fb_w || y >= shim_fb_h || w == 0 || h == 0) return -1;
+    if (w > shim_fb_w - x) w = shim_fb_w - x;
+    if (h > shim_fb_h - y) h = shim_fb_h - y;
+    uint8_t *row = (uint8_t*)shim_fb_ptr + y * shim_fb_pitch + x * (shim_fb_bpp/8);
+    for (uint32_t r = 0; r < h; r++, row += shim_fb_pitch, src += pitch) {
+        if (shim_fb_bpp == 32) {
+            kmemcpy(row, src, w * 4);
+        } else {
+            uint8_t *p = row;
+            for (uint32_t c = 0; c < w; c++, p += 3) {
+                p[0] = (uint8_t)(src[c] & 0xFF);
+                p[1] = (uint8_t)((src[c] >> 8) & 0xFF);
+                p[2] = (uint8_t)((src[c] >> 16) & 0xFF);
+            }
+        }
+    }
+    return 0;
+}
 void fb_status(char *buf, int buflen) {
     if (!buf || buflen <= 0) return;
     if (shim_fb_ok) {
@@ -407,48 +382,24 @@ void fb_status(char *buf, int buflen) {
 }
 static void vga_scroll_if_needed(void) {
     if (cursor_y < VGA_HEIGHT) return;
-    /* before shifting, push the top line being discarded into scrollback */
-    scroll_push_top_line();
-    // Scroll up by one line
-    for (int y = 0; y < VGA_HEIGHT - 1; y++) {
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            vga[y * VGA_WIDTH + x] = vga[(y + 1) * VGA_WIDTH + x];
-        }
-    }
-    // Clear bottom line
-    for (int x = 0; x < VGA_WIDTH; x++) {
-        vga[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = (current_color << 8) | ' ';
-    }
+    con_shift_up((current_color << 8) | ' ');
     cursor_y = VGA_HEIGHT - 1;
 }
 void vga_scroll(int lines) {
     if (lines <= 0) return;
    
-    for (int i = 0; i < lines; i++) {
-        // Move all lines up by one
-        for (int y = 0; y < VGA_HEIGHT - 1; y++) {
-            for (int x = 0; x < VGA_WIDTH; x++) {
-                vga[y * VGA_WIDTH + x] = vga[(y + 1) * VGA_WIDTH + x];
-            }
-        }
-       
-        // Clear bottom line
-        for (int x = 0; x < VGA_WIDTH; x++) {
-            vga[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = (current_color << 8) | ' ';
-        }
-    }
+    for (int i = 0; i < lines; i++) con_shift_up((current_color << 8) | ' ');
    
     if (cursor_y >= lines) {
         cursor_y -= lines;
     } else {
         cursor_y = 0;
     }
+    con_flush();
 }
-void putc_k(char ch) {
+static void con_putc(char ch) {
     switch (ch) {
         case '\n':
-            /* push the just-completed line into scrollback, then advance */
-            scroll_push_line_from_row(cursor_y);
             cursor_x = 0;
             cursor_y++;
             vga_scroll_if_needed();
@@ -467,129 +418,46 @@ void putc_k(char ch) {
         case '\b':
             if (cursor_x > 0) {
                 cursor_x--;
-                vga[cursor_y * VGA_WIDTH + cursor_x] = (current_color << 8) | ' ';
+                con_row(cursor_y)[cursor_x] = (current_color << 8) | ' ';
             }
             break;
         default:
-            vga[cursor_y * VGA_WIDTH + cursor_x] = (current_color << 8) | ch;
+            con_row(cursor_y)[cursor_x] = (current_color << 8) | ch;
             cursor_x++;
             if (cursor_x >= VGA_WIDTH) {
                 cursor_x = 0;
                 cursor_y++;
                 vga_scroll_if_needed();
-                /* pushing page will be handled by scroll_if_needed when needed */
             }
             break;
     }
 }
-void puts_k(const char* s) {
-    while (*s) putc_k(*s++);
+static void con_puts(const char* s) {
+    while (*s) con_putc(*s++);
 }
-/* Simple printf implementation without stdarg.h */
-static void print_int(int val) {
-    if (val == 0) {
-        putc_k('0');
-        return;
-    }
-   
-    if (val < 0) {
-        putc_k('-');
-        val = -val;
-    }
-   
-    char buf[12];
-    int pos = 0;
-   
-    while (val) {
-        buf[pos++] = '0' + (val % 10);
-        val /= 10;
-    }
-   
-    while (pos--) {
-        putc_k(buf[pos]);
-    }
+void putc_k(char ch) {
+    serial_mirror_write(&ch, 1);
+    con_putc(ch);
+    con_flush();
 }
-static void print_hex(uint32_t val) {
-    char hex[] = "0123456789ABCDEF";
-   
-    putc_k('0');
-    putc_k('x');
-   
-    int started = 0;
-    for (int shift = 28; shift >= 0; shift -= 4) {
-        int nibble = (val >> shift) & 0xF;
-        if (nibble || started) {
-            putc_k(hex[nibble]);
-            started = 1;
-        }
-    }
-   
-    if (!started) {
-        putc_k('0');
-    }
+void puts_k(const char* s) {
+    serial_mirror_write(s, (int)kstrlen(s));
+    con_puts(s);
+    con_flush();
 }
-static void print_uint(uint32_t val) {
-    if (val == 0) {
-        putc_k('0');
-        return;
-    }
-   
-    char buf[12];
-    int pos = 0;
-   
-    while (val) {
-        buf[pos++] = '0' + (val % 10);
-        val /= 10;
-    }
-   
-    while (pos--) {
-        putc_k(buf[pos]);
-    }
+/* formatter sink that draws into the console; callers flush */
+static void con_sink_write(kfmt_sink_t *sink, const char *s, int len) {
+    (void)sink;
+    serial_mirror_write(s, len);
+    while (len--) con_putc(*s++);
 }
+static kfmt_sink_t con_sink = { con_sink_write };
 void printf_k(const char* fmt, ...) {
     va_list args;
-    __builtin_va_start(args, fmt);
-   
-    for (int i = 0; fmt[i]; i++) {
-        if (fmt[i] != '%') {
-            putc_k(fmt[i]);
-            continue;
-        }
-       
-        i++;
-        switch (fmt[i]) {
-            case 's': {
-                char* s = __builtin_va_arg(args, char*);
-                puts_k(s);
-                break;
-            }
-            case 'c': {
-                char c = (char)__builtin_va_arg(args, int);
-                putc_k(c);
-                break;
-            }
-            case 'd': {
-                int val = __builtin_va_arg(args, int);
-                print_int(val);
-                break;
-            }
-            case 'x': {
-                uint32_t val = __builtin_va_arg(args, uint32_t);
-                print_hex(val);
-                break;
-            }
-            case 'u': {
-                uint32_t val = __builtin_va_arg(args, uint32_t);
-                print_uint(val);
-                break;
-            }
-            default:
-                putc_k(fmt[i]);
-                break;
-        }
-    }
-   
-    __builtin_va_end(args);
+    va_start(args, fmt);
+    kvformat(&con_sink, fmt, args);
+    va_end(args);
+    con_flush();
 }
 /* ===================== Keyboard ===================== */
 static const char keymap_normal[128] = {
@@ -604,165 +472,161 @@ static const char keymap_shift[128] = {
     'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~', 0, '|',
     'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0, '*', 0, ' '
 };
+/* Scancodes are queued by the IRQ1 handler and consumed by
+   kbd_getchar/kbd_getscancode. One producer (the interrupt) and one
+   consumer (the foreground thread, see kbd_is_foreground) means head and
+   tail each have a single writer, so no locking is needed; keys typed
+   while the kernel is busy wait here instead of being dropped. */
+#define KBD_RING_SIZE 128 /* power of two */
+static volatile uint8_t kbd_ring[KBD_RING_SIZE];
+static volatile uint32_t kbd_head; /* written only by the IRQ handler */
+static volatile uint32_t kbd_tail; /* written only by the consumer */
+
+static void kbd_irq(void) {
+    uint8_t sc = inb(0x60);
+    uint32_t head = kbd_head;
+    if (head - kbd_tail >= KBD_RING_SIZE) return; /* full: drop the newest */
+    kbd_ring[head & (KBD_RING_SIZE - 1)] = sc;
+    __asm__ volatile ("" ::: "memory"); /* publish the byte before the index */
+    kbd_head = head + 1;
+}
+
+static int kbd_ring_pop(void) {
+    uint32_t tail = kbd_tail;
+    if (tail == kbd_head) return -1;
+    uint8_t sc = kbd_ring[tail & (KBD_RING_SIZE - 1)];
+    __asm__ volatile ("" ::: "memory");
+    kbd_tail = tail + 1;
+    return sc;
+}
+
+/* block until a scancode is queued, letting other threads run or halting
+   the CPU meanwhile. IF may be clear (e.g. readline from the syscall
+   gate); sched_idle enables it for the wait and restores it. */
+static uint8_t kbd_wait_scancode(void) {
+    int sc = kbd_ring_pop();
+    if (sc >= 0) return (uint8_t)sc;
+    con_flush(); /* show everything drawn so far before going idle */
+    while ((sc = kbd_ring_pop()) < 0) sched_idle();
+    return (uint8_t)sc;
+}
+
 void kbd_init(void) {
-    // Nothing to initialize for polling mode
+    /* discard anything the controller buffered before we took over */
+    while (inb(0x64) & 1) (void)inb(0x60);
+    irq_install(IRQ_KEYBOARD, kbd_irq);
+}
+int kbd_is_foreground(void) {
+    return thread_current() == KBD_FOREGROUND_TID;
 }
 char kbd_getchar(void) {
     static int shift_pressed = 0;
     static int ctrl_pressed = 0;
     static int alt_pressed = 0;
+    if (!kbd_is_foreground()) return 0;
     while (1) {
-        if (inb(0x64) & 1) {
-            uint8_t scancode = inb(0x60);
-            /* handle extended scancode prefix 0xE0 for arrow keys */
-            if (scancode == 0xE0) {
-                /* wait for next scancode */
-                while (!(inb(0x64) & 1));
-                uint8_t sc2 = inb(0x60);
-                /* ignore releases (have 0x80 bit) */
-                if (sc2 & 0x80) continue;
-                /* Up arrow = 0x48, Down arrow = 0x50 */
-                if (sc2 == 0x48) {
-                    /* If readline is active, return special code for history navigation */
-                    if (readline_active) return KEY_UP;
-                    /* Enter or advance scrollback view */
-                    if (scroll_count_lines == 0) continue;
-                    int S = SCROLL_LINES;
-                    if (!scroll_viewing) {
-                        save_live_screen();
-                        scroll_viewing = 1;
-                        /* show last VGA_HEIGHT lines */
-                        int show_lines = (scroll_count_lines < VGA_HEIGHT ? scroll_count_lines : VGA_HEIGHT);
-                        scroll_view_top = (scroll_next_write - show_lines + S) % S;
-                    } else {
-                        /* scroll up by one line, clamped */
-                        int current_forward = (scroll_next_write - scroll_view_top + S) % S;
-                        int dist_to_top = scroll_count_lines - current_forward;
-                        if (dist_to_top > 0) {
-                            scroll_view_top = (scroll_view_top - 1 + S) % S;
-                        }
-                    }
-                    render_scroll_from_index(scroll_view_top);
-                    /* draw HISTORY indicator at top-right */
-                    const char *hint = "HISTORY";
-                    int pos = VGA_WIDTH - 7;
-                    for (int i = 0; i < 7; i++) vga[pos + i] = ((current_color << 8) | hint[i]);
-                    continue;
-                } else if (sc2 == 0x50) {
-                    if (readline_active) return KEY_DOWN;
-                    if (!scroll_viewing) continue;
-                    /* page down by one line */
-                    scroll_view_top = (scroll_view_top + 1) % SCROLL_LINES;
-                    /* if we've reached the newest (next write index), restore live */
-                    if (scroll_view_top == scroll_next_write) {
-                        restore_live_screen();
-                        scroll_viewing = 0;
-                    } else {
-                        render_scroll_from_index(scroll_view_top);
-                        const char *hint = "HISTORY";
-                        int pos = VGA_WIDTH - 7;
-                        for (int i = 0; i < 7; i++) vga[pos + i] = ((current_color << 8) | hint[i]);
-                    }
-                    continue;
-                } else if (sc2 == 0x49) { /* Page Up */
-                    if (readline_active) continue;
-                    if (scroll_count_lines == 0) continue;
-                    int S = SCROLL_LINES;
-                    if (!scroll_viewing) {
-                        save_live_screen();
-                        scroll_viewing = 1;
-                        int show_lines = (scroll_count_lines < VGA_HEIGHT ? scroll_count_lines : VGA_HEIGHT);
-                        scroll_view_top = (scroll_next_write - show_lines + S) % S;
-                    } else {
-                        int current_forward = (scroll_next_write - scroll_view_top + S) % S;
-                        int move_amount = (VGA_HEIGHT < (scroll_count_lines - current_forward) ? VGA_HEIGHT : (scroll_count_lines - current_forward));
-                        if (move_amount > 0) {
-                            scroll_view_top = (scroll_view_top - move_amount + S) % S;
-                        }
-                    }
-                    render_scroll_from_index(scroll_view_top);
-                    const char *hint = "HISTORY";
-                    int pos = VGA_WIDTH - 7;
-                    for (int i = 0; i < 7; i++) vga[pos + i] = ((current_color << 8) | hint[i]);
-                    continue;
-                } else if (sc2 == 0x51) { /* Page Down */
-                    if (readline_active) continue;
-                    if (!scroll_viewing) continue;
-                    int S = SCROLL_LINES;
-                    int current_forward = (scroll_next_write - scroll_view_top + S) % S;
-                    if (current_forward <= VGA_HEIGHT) {
-                        restore_live_screen();
-                        scroll_viewing = 0;
-                    } else {
-                        int move_amount = (VGA_HEIGHT < (current_forward - VGA_HEIGHT) ? VGA_HEIGHT : (current_forward - VGA_HEIGHT));
-                        scroll_view_top = (scroll_view_top + move_amount) % S;
-                        render_scroll_from_index(scroll_view_top);
-                        const char *hint = "HISTORY";
-                        int pos = VGA_WIDTH - 7;
-                        for (int i = 0; i < 7; i++) vga[pos + i] = ((current_color << 8) | hint[i]);
-                    }
-                    continue;
-                } else {
-                    continue;
-                }
-            }
-            // Check for key release
-            if (scancode & 0x80) {
-                uint8_t key = scancode & 0x7F;
-                if (key == 0x2A || key == 0x36) shift_pressed = 0;
-                if (key == 0x1D) ctrl_pressed = 0;
-                if (key == 0x38) alt_pressed = 0;
+        uint8_t scancode = kbd_wait_scancode();
+        /* handle extended scancode prefix 0xE0 for arrow keys */
+        if (scancode == 0xE0) {
+            /* the second byte is normally already queued */
+            uint8_t sc2 = kbd_wait_scancode();
+            /* ignore releases (have 0x80 bit) */
+            if (sc2 & 0x80) continue;
+            /* Up arrow = 0x48, Down arrow = 0x50 */
+            if (sc2 == 0x48) {
+                /* If readline is active, return special code for history navigation */
+                if (readline_active) return KEY_UP;
+                scroll_view_move(-1);
                 continue;
-            }
-            // Key press
-            if (scancode == 0x2A || scancode == 0x36) {
-                shift_pressed = 1;
+            } else if (sc2 == 0x50) {
+                if (readline_active) return KEY_DOWN;
+                if (scroll_viewing) scroll_view_move(1);
                 continue;
-            }
-            if (scancode == 0x1D) {
-                ctrl_pressed = 1;
+            } else if (sc2 == 0x49) { /* Page Up */
+                scroll_view_move(-VGA_HEIGHT);
                 continue;
-            }
-            if (scancode == 0x38) {
-                alt_pressed = 1;
+            } else if (sc2 == 0x51) { /* Page Down */
+                if (scroll_viewing) scroll_view_move(VGA_HEIGHT);
+                continue;
+            } else {
                 continue;
             }
-            if (scancode < 128) {
-                /* if we are viewing history and this is a normal key, restore live */
-                if (scroll_viewing) {
-                    restore_live_screen();
-                    scroll_viewing = 0;
-                }
-                if (ctrl_pressed && scancode == 'l' - 'a' + 1) {
-                    vga_clear();
-                    cursor_x = cursor_y = 0;
-                    return 0;
-                }
-                if (shift_pressed) {
-                    return keymap_shift[scancode];
-                } else {
-                    return keymap_normal[scancode];
-                }
+        }
+        // Check for key release
+        if (scancode & 0x80) {
+            uint8_t key = scancode & 0x7F;
+            if (key == 0x2A || key == 0x36) shift_pressed = 0;
+            if (key == 0x1D) ctrl_pressed = 0;
+            if (key == 0x38) alt_pressed = 0;
+            continue;
+        }
+        // Key press
+        if (scancode == 0x2A || scancode == 0x36) {
+            shift_pressed = 1;
+            continue;
+        }
+        if (scancode == 0x1D) {
+            ctrl_pressed = 1;
+            continue;
+        }
+        if (scancode == 0x38) {
+            alt_pressed = 1;
+            continue;
+        }
+        if (scancode < 128) {
+            /* if we are viewing history and this is a normal key, restore live */
+            if (scroll_viewing) restore_live_screen();
+            if (ctrl_pressed && scancode == 'l' - 'a' + 1) {
+                vga_clear();
+                cursor_x = cursor_y = 0;
+                return 0;
+            }
+            if (shift_pressed) {
+                return keymap_shift[scancode];
+            } else {
+                return keymap_normal[scancode];
             }
         }
     }
 }
+/* next queued scancode, or -1 without waiting */
 int kbd_getscancode(void) {
-    if (inb(0x64) & 1) {
-        return inb(0x60);
-    }
-    return -1;
+    if (!kbd_is_foreground()) return -1;
+    return kbd_ring_pop();
 }
 int kbd_iskeypressed(void) {
-    return (inb(0x64) & 1) != 0;
+    return kbd_head != kbd_tail;
+}
+/* readline's echo goes through con_putc so long input wraps and scrolls
+ * like any other output; rl_rubout is its exact inverse, stepping back
+ * over a wrap to the end of the previous row */
+static void rl_echo(char ch) {
+    con_putc((unsigned char)ch >= ' ' ? ch : ' '); /* one cell per byte */
+}
+static void rl_rubout(void) {
+    if (cursor_x > 0) {
+        cursor_x--;
+    } else if (cursor_y > 0) {
+        cursor_y--;
+        cursor_x = VGA_WIDTH - 1;
+    } else {
+        return; /* the start of the input has scrolled off */
+    }
+    con_row(cursor_y)[cursor_x] = (current_color << 8) | ' ';
+}
+/* replace the 'shown' characters on screen with history entry 'idx' */
+static int rl_recall(char *buf, int bufsize, int idx, int shown) {
+    int i = 0;
+    while (i < bufsize - 1 && history[idx][i]) { buf[i] = history[idx][i]; i++; }
+    buf[i] = 0;
+    while (shown-- > 0) rl_rubout();
+    for (int k = 0; k < i; k++) rl_echo(buf[k]);
+    return i;
 }
 int readline(char* buf, int bufsize) {
     int pos = 0;
     int history_pos = -1; /* local selection index for history (offset from newest) */
-    int prev_len = 0; /* previous displayed input length for clearing */
-    /* record cursor start position so we can overwrite the input line when
-     * navigating history */
-    int start_x = cursor_x;
+    if (!kbd_is_foreground()) return -1;
     readline_active = 1;
     while (1) {
         char ch = kbd_getchar();
@@ -772,19 +636,7 @@ int readline(char* buf, int bufsize) {
             if (history_pos < history_count - 1) history_pos++; /* older */
             else history_pos = history_count - 1;
             int idx = (history_next - 1 - history_pos + HISTORY_SIZE) % HISTORY_SIZE;
-            /* copy into buf */
-            int i = 0; while (i < bufsize - 1 && history[idx][i]) { buf[i] = history[idx][i]; i++; }
-            buf[i] = 0; pos = i;
-            /* visually replace current input */
-            /* clear previous */
-            vga_set_cursor(start_x, cursor_y);
-            for (int k = 0; k < prev_len; k++) { vga[cursor_y * VGA_WIDTH + start_x + k] = (current_color << 8) | ' '; }
-            /* write new */
-            vga_set_cursor(start_x, cursor_y);
-            for (int k = 0; k < pos; k++) { vga[cursor_y * VGA_WIDTH + start_x + k] = (current_color << 8) | buf[k]; }
-            cursor_x = start_x + pos;
-            update_hardware_cursor();
-            prev_len = pos;
+            pos = rl_recall(buf, bufsize, idx, pos);
             continue;
         }
         if (ch == KEY_DOWN) {
@@ -792,36 +644,33 @@ int readline(char* buf, int bufsize) {
             if (history_pos <= 0) {
                 /* clear input */
                 history_pos = -1;
-                for (int k = 0; k < prev_len; k++) vga[cursor_y * VGA_WIDTH + start_x + k] = (current_color << 8) | ' ';
-                cursor_x = start_x;
-                update_hardware_cursor();
-                pos = 0; prev_len = 0; buf[0] = 0;
+                while (pos > 0) { pos--; rl_rubout(); }
+                buf[0] = 0;
             } else {
                 history_pos--;
                 int idx = (history_next - 1 - history_pos + HISTORY_SIZE) % HISTORY_SIZE;
-                int i = 0; while (i < bufsize - 1 && history[idx][i]) { buf[i] = history[idx][i]; i++; }
-                buf[i] = 0; pos = i;
-                /* replace visually */
-                vga_set_cursor(start_x, cursor_y);
-                for (int k = 0; k < prev_len; k++) vga[cursor_y * VGA_WIDTH + start_x + k] = (current_color << 8) | ' ';
-                vga_set_cursor(start_x, cursor_y);
-                for (int k = 0; k < pos; k++) vga[cursor_y * VGA_WIDTH + start_x + k] = (current_color << 8) | buf[k];
-                cursor_x = start_x + pos;
-                update_hardware_cursor();
-                prev_len = pos;
+                pos = rl_recall(buf, bufsize, idx, pos);
             }
             continue;
         }
         if (ch == '\n') {
+            /* the line was edited in place on screen; mirror the result */
+            serial_mirror_write(buf, pos);
             putc_k('\n');
             buf[pos] = 0;
             /* save into history if non-empty */
             if (pos > 0) {
                 int hidx = history_next % HISTORY_SIZE;
-                int i = 0; while (i < HISTORY_LEN - 1 && i < pos) { history[hidx][i] = buf[i]; i++; }
-                history[hidx][i] = 0;
-                history_next = (history_next + 1) % HISTORY_SIZE;
-                if (history_count < HISTORY_SIZE) history_count++;
+                int len = pos < HISTORY_LEN - 1 ? pos : HISTORY_LEN - 1;
+                char *line = (char*)kmalloc(len + 1);
+                if (line) {
+                    int i = 0; while (i < len) { line[i] = buf[i]; i++; }
+                    line[i] = 0;
+                    kfree(history[hidx]);
+                    history[hidx] = line;
+                    history_next = (history_next + 1) % HISTORY_SIZE;
+                    if (history_count < HISTORY_SIZE) history_count++;
+                }
             }
             readline_active = 0;
             return pos;
@@ -829,17 +678,7 @@ int readline(char* buf, int bufsize) {
         if (ch == '\b') {
             if (pos > 0) {
                 pos--;
-                /* Erase character visually */
-                if (cursor_x == 0) {
-                    if (cursor_y > 0) {
-                        cursor_y--;
-                        cursor_x = VGA_WIDTH - 1;
-                    }
-                } else {
-                    cursor_x--;
-                }
-                vga[cursor_y * VGA_WIDTH + cursor_x] = (current_color << 8) | ' ';
-                prev_len = pos;
+                rl_rubout();
             }
             continue;
         }
@@ -848,150 +687,20 @@ int readline(char* buf, int bufsize) {
         if (ch == 21) { // Ctrl+U
             while (pos > 0) {
                 pos--;
-                if (cursor_x == 0) {
-                    if (cursor_y > 0) {
-                        cursor_y--;
-                        cursor_x = VGA_WIDTH - 1;
-                    }
-                } else {
-                    cursor_x--;
-                }
-                vga[cursor_y * VGA_WIDTH + cursor_x] = (current_color << 8) | ' ';
+                rl_rubout();
             }
-            prev_len = 0;
             continue;
         }
         if (pos < bufsize - 1) {
             buf[pos++] = ch;
-            /* print char visually */
-            vga[cursor_y * VGA_WIDTH + cursor_x] = (current_color << 8) | ch;
-            cursor_x++;
-            update_hardware_cursor();
-            prev_len = pos;
+            rl_echo(ch);
         }
     }
 }
-/* ===================== Serial Port ===================== */
-void serial_init(uint16_t port) {
-     (port + 1, 0x00); // Disable interrupts
-    outb(port + 3, 0x80); // Enable DLAB
-    outb(port + 0, 0x03); // 38400 baud
-    outb(port + 1, 0x00);
-    outb(port + 3, 0x03); // 8 bits, no parity, one stop bit
-    outb(port + 2, 0xC7); // Enable FIFO
-    outb(port + 4, 0x0B); // IRQs enabled, RTS/DSR set
-}
-int serial_is_transmit_empty(uint16_t port) {
-    return inb(port + 5) & 0x20;
-}
-void serial_putc(uint16_t port, char c) {
-    while (!serial_is_transmit_empty(port));
-    outb(port, c);
-}
-void serial_puts(uint16_t port, const char* s) {
-    while (*s) {
-        serial_putc(port, *s++);
-    }
-}
-void serial_printf(uint16_t port, const char* fmt, ...) {
-    va_list args;
-    __builtin_va_start(args, fmt);
-   
-    char buffer[256];
-    int pos = 0;
-   
-    for (int i = 0; fmt[i] && pos < 255; i++) {
-        if (fmt[i] != '%') {
-            buffer[pos++] = fmt[i];
-            continue;
-        }
-       
-        i++;
-        switch (fmt[i]) {
-            case 's': {
-                char* s = __builtin_va_arg(args, char*);
-                while (*s && pos < 255) buffer[pos++] = *s++;
-                break;
-            }
-            case 'c': {
-                char c = (char)__builtin_va_arg(args, int);
-                if (pos < 255) buffer[pos++] = c;
-                break;
-            }
-            case 'd': {
-                int val = __builtin_va_arg(args, int);
-                char num[12];
-                int num_pos = 0;
-                if (val == 0) {
-                    num[num_pos++] = '0';
-                } else {
-                    if (val < 0) {
-                        if (pos < 255) buffer[pos++] = '-';
-                        val = -val;
-                    }
-                    while (val) {
-                        num[num_pos++] = '0' + (val % 10);
-                        val /= 10;
-                    }
-                }
-                while (num_pos--) {
-                    if (pos < 255) buffer[pos++] = num[num_pos];
-                }
-                break;
-            }
-            default:
-                if (pos < 255) buffer[pos++] = fmt[i];
-                break;
-        }
-    }
-   
-    buffer[pos] = 0;
-    serial_puts(port, buffer);
-   
-    __builtin_va_end(args);
-}
 void printf_col(const char* fmt, ...) {
     va_list args;
-    __builtin_va_start(args, fmt);
-   
-    for (int i = 0; fmt[i]; i++) {
-        if (fmt[i] != '%') {
-            putc_k(fmt[i]);
-            continue;
-        }
-       
-        i++;
-        switch (fmt[i]) {
-            case 's': {
-                char* s = __builtin_va_arg(args, char*);
-                puts_k(s);
-                break;
-            }
-            case 'c': {
-                char c = (char)__builtin_va_arg(args, int);
-                putc_k(c);
-                break;
-            }
-            case 'd': {
-                int val = __builtin_va_arg(args, int);
-                print_int(val);
-                break;
-            }
-            case 'x': {
-                uint32_t val = __builtin_va_arg(args, uint32_t);
-                print_hex(val);
-                break;
-            }
-            case 'u': {
-                uint32_t val = __builtin_va_arg(args, uint32_t);
-                print_uint(val);
-                break;
-            }
-            default:
-                putc_k(fmt[i]);
-                break;
-        }
-    }
-   
-    __builtin_va_end(args);
+    va_start(args, fmt);
+    kvformat(&con_sink, fmt, args);
+    va_end(args);
+    con_flush();
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -18,8 +19,6 @@ extern int cursor_y;
 
 /* ATA PIO */
 //void ata_init(void);
-void ata_read_lba28(uint32_t lba, uint8_t sectors, void* buffer);
-void ata_write_lba28(uint32_t lba, uint8_t sectors, const void* buffer);
 int ata_identify(void);
 
 /* VGA Text Mode */
@@ -51,26 +50,30 @@ void printf_k(const char* fmt, ...);
 void vga_scroll(int lines);
 void vga_set_cursor(int x, int y);
 void vga_get_cursor(int* x, int* y);
+void con_flush(void); /* copy pending console changes to VRAM */
 
-/* Keyboard */
+/* Keyboard. The keyboard has one owner, the foreground thread: the shell
+   (thread 0), which also runs "run" programs. Only it consumes keys; from
+   any other thread kbd_getchar returns 0, kbd_getscancode -1 and readline
+   -1, so a spawned program cannot steal input from the shell. */
+#define KBD_FOREGROUND_TID 0
 void kbd_init(void);
+int kbd_is_foreground(void);
 char kbd_getchar(void);
 int kbd_getscancode(void);
 int kbd_iskeypressed(void);
 int readline(char* buf, int bufsize);
 
 /* Serial Port */
-void serial_init(uint16_t port);
-void serial_putc(uint16_t port, char c);
-void serial_puts(uint16_t port, const char* s);
-void serial_printf(uint16_t port, const char* fmt, ...);
+#include "serial.h"
 
 /* Simple string functions (since we don't have libc) */
 int strcmp(const char* s1, const char* s2);
 char* strcpy(char* dest, const char* src);
 uint32_t strlen(const char* s);
-void* memcpy(void* dest, const void* src, uint32_t n);
-void* memset(void* dest, uint8_t val, uint32_t n);
+/* memcpy/memset live in kstring.c on top of kmemcpy/kmemset */
+void* memcpy(void* dest, const void* src, size_t n);
+void* memset(void* dest, int val, size_t n);
 
 void clrscr(void);
 int putchar_col(int c);
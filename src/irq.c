@@ -0,0 +1,79 @@
+/* irq.c - 8259 PIC setup and IRQ dispatch.
+   Both PICs are remapped away from the CPU exception vectors to
+   0x20-0x2F and start fully masked; drivers unmask their line through
+   irq_install. The EOI is sent here after the handler returns, then the
+   scheduler gets its chance to preempt, and the
+   spurious IRQ 7 / IRQ 15 the PIC can raise are filtered out by checking
+   the in-service register.
+*/
+
+#include "irq.h"
+#include "port.h"
+#include "sched.h"
+#include <stdint.h>
+
+#define PIC1_CMD  0x20
+#define PIC1_DATA 0x21
+#define PIC2_CMD  0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI   0x20
+#define PIC_READ_ISR 0x0B
+
+static irq_handler_t handlers[16];
+
+static inline void io_wait(void) {
+    outb(0x80, 0); /* unused POST port: a short delay for old PICs */
+}
+
+void irq_init(void) {
+    /* ICW1: edge triggered, cascade, expect ICW4 */
+    outb(PIC1_CMD, 0x11); io_wait();
+    outb(PIC2_CMD, 0x11); io_wait();
+    /* ICW2: vector offsets */
+    outb(PIC1_DATA, IRQ_VECTOR_BASE); io_wait();
+    outb(PIC2_DATA, IRQ_VECTOR_BASE + 8); io_wait();
+    /* ICW3: slave on IRQ2 */
+    outb(PIC1_DATA, 1 << IRQ_CASCADE); io_wait();
+    outb(PIC2_DATA, 2); io_wait();
+    /* ICW4: 8086 mode */
+    outb(PIC1_DATA, 0x01); io_wait();
+    outb(PIC2_DATA, 0x01); io_wait();
+    /* everything masked except the cascade line */
+    outb(PIC1_DATA, (uint8_t)~(1 << IRQ_CASCADE));
+    outb(PIC2_DATA, 0xFF);
+}
+
+void irq_mask(int irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (uint8_t)(1 << (irq & 7)));
+}
+
+void irq_unmask(int irq) {
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & (uint8_t)~(1 << (irq & 7)));
+}
+
+void irq_install(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq > 15) return;
+    handlers[irq] = handler;
+    irq_unmask(irq);
+}
+
+static int irq_in_service(int irq) {
+    uint16_t port = irq < 8 ? PIC1_CMD : PIC2_CMD;
+    outb(port, PIC_READ_ISR);
+    return (inb(port) >> (irq & 7)) & 1;
+}
+
+void irq_dispatch(uint32_t irq) {
+    if (irq == 7 && !irq_in_service(7)) return; /* spurious: no EOI */
+    if (irq == 15 && !irq_in_service(15)) {
+        outb(PIC1_CMD, PIC_EOI); /* the master did see the cascade */
+        return;
+    }
+    if (handlers[irq]) handlers[irq]();
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+    /* only now, with the PIC acknowledged, may this thread be switched out */
+    sched_irq_exit();
+}
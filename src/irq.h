@@ -0,0 +1,30 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+/* Legacy 8259 PIC pair, remapped so IRQ 0-15 arrive on vectors
+   IRQ_VECTOR_BASE .. IRQ_VECTOR_BASE + 15. */
+
+#define IRQ_VECTOR_BASE 0x20
+
+#define IRQ_TIMER    0
+#define IRQ_KEYBOARD 1
+#define IRQ_CASCADE  2
+#define IRQ_COM1     4
+
+typedef void (*irq_handler_t)(void);
+
+/* remap both PICs and mask every line */
+void irq_init(void);
+
+/* set the handler for 'irq' and unmask it; a handler runs with
+   interrupts disabled and must not send the EOI itself */
+void irq_install(int irq, irq_handler_t handler);
+void irq_mask(int irq);
+void irq_unmask(int irq);
+
+/* called from the assembly stubs in irq_entry.s */
+void irq_dispatch(uint32_t irq);
+
+#endif
@@ -0,0 +1,59 @@
+/* irq_entry.s - entry stubs for the 16 legacy PIC interrupts (vectors 0x20-0x2F).
+ * Each stub pushes its IRQ number and joins irq_common, which saves the
+ * general registers and the data segments, loads the kernel's and calls
+ * irq_dispatch(irq) in irq.c. The interrupted code may be a program that
+ * left any selector in DS/ES and the direction flag set.
+ */
+    .section .text
+
+    .macro IRQ_STUB n
+irq_stub_\n:
+    pushl $\n
+    jmp irq_common
+    .endm
+
+    IRQ_STUB 0
+    IRQ_STUB 1
+    IRQ_STUB 2
+    IRQ_STUB 3
+    IRQ_STUB 4
+    IRQ_STUB 5
+    IRQ_STUB 6
+    IRQ_STUB 7
+    IRQ_STUB 8
+    IRQ_STUB 9
+    IRQ_STUB 10
+    IRQ_STUB 11
+    IRQ_STUB 12
+    IRQ_STUB 13
+    IRQ_STUB 14
+    IRQ_STUB 15
+
+irq_common:
+    pushal
+    pushl %ds
+    pushl %es
+    movw $0x10, %ax                 /* GDT_KERNEL_DATA */
+    movw %ax, %ds
+    movw %ax, %es
+    cld
+    /* IRQ number sits just above the segments and eight saved registers */
+    movl 40(%esp), %eax
+    pushl %eax
+    call irq_dispatch
+    addl $4, %esp
+    popl %es
+    popl %ds
+    popal
+    addl $4, %esp   /* drop the IRQ number */
+    iret
+
+    /* table used by idt_init to fill vectors 0x20-0x2F */
+    .section .rodata
+    .globl irq_stubs
+    .align 4
+irq_stubs:
+    .long irq_stub_0, irq_stub_1, irq_stub_2, irq_stub_3
+    .long irq_stub_4, irq_stub_5, irq_stub_6, irq_stub_7
+    .long irq_stub_8, irq_stub_9, irq_stub_10, irq_stub_11
+    .long irq_stub_12, irq_stub_13, irq_stub_14, irq_stub_15
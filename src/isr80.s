@@ -1,13 +1,77 @@
     .section .text
     .globl isr80_stub
 isr80_stub:
-    /* Save general registers */
+    /* Save general registers, then the caller's data segments: a program
+     * may leave any selector in DS/ES and the direction flag set */
     pushal
-    /* Pass pointer to regs (current esp) to C handler */
-    movl %esp, %eax
+    pushl %ds
+    pushl %es
+    movw $0x10, %ax                 /* GDT_KERNEL_DATA */
+    movw %ax, %ds
+    movw %ax, %es
+    cld
+    /* Pass pointer to regs (above the segments) to C handler */
+    leal 8(%esp), %eax
     pushl %eax
-    call isr80_handler
+    call syscall_dispatch
     addl $4, %esp
-    /* Restore registers and return from interrupt */
+    /* Restore segments and registers and return from interrupt */
+    popl %es
+    popl %ds
     popal
     iret
+
+    /* SYSENTER lands here on the kernel stack from MSR_SYSENTER_ESP with
+     * interrupts off. ECX points at the caller's frame on the user stack:
+     * [0] resume address, [4] ECX argument, [8] EDX argument (syscall.h).
+     * The frame must lie in the program's mapped areas before it is read.
+     * The same pushal-ordered frame isr80_stub builds is assembled from
+     * that, so both entries share syscall_dispatch. */
+    .globl sysenter_entry
+sysenter_entry:
+    pushl %ds
+    pushl %es
+    pushl %eax
+    movw $0x10, %ax                 /* GDT_KERNEL_DATA */
+    movw %ax, %ds
+    movw %ax, %es
+    cld
+    pushl %ecx
+    pushl $0                        /* read access */
+    pushl $12
+    pushl %ecx
+    call vmm_check_user
+    addl $12, %esp
+    popl %ecx
+    testl %eax, %eax
+    popl %eax                       /* syscall number; flags survive */
+    jnz 1f
+    pushl %ecx                      /* user stack pointer for sysexit */
+    pushl (%ecx)                    /* resume address */
+    pushl %eax
+    pushl 4(%ecx)                   /* ECX */
+    pushl 8(%ecx)                   /* EDX */
+    pushl %ebx
+    pushl $0                        /* ESP slot, unused */
+    pushl %ebp
+    pushl %esi
+    pushl %edi
+    movl %esp, %eax
+    pushl %eax
+    call syscall_dispatch
+    addl $4, %esp
+    popl %edi
+    popl %esi
+    popl %ebp
+    addl $4, %esp
+    popl %ebx
+    addl $8, %esp                   /* EDX, ECX: the caller reloads them */
+    popl %eax
+    popl %edx                       /* sysexit: EIP */
+    popl %ecx                       /* sysexit: ESP */
+    popl %es
+    popl %ds
+    sti                             /* takes effect after sysexit */
+    sysexit
+1:
+    call syscall_bad_frame          /* does not return */
@@ -6,10 +6,24 @@
 #include "kstring.h"
 #include "fs.h"
 #include "ata.h"
+#include "bcache.h"
 #include "interrupt.h"
 #include "bmp.h"
 #include "vga_mode13.h"
 #include "framebuffer.h"
+#include "port.h"
+#include "irq.h"
+#include "timer.h"
+#include "pmm.h"
+#include "kmalloc.h"
+#include "slab.h"
+#include "trace.h"
+#include "kformat.h"
+#include "multiboot.h"
+#include "elf.h"
+#include "vmm.h"
+#include "sched.h"
+#include "gdt.h"
 #include "tetris.c"
 
 // ========== UI CONFIGURATION ==========
@@ -97,10 +111,15 @@ void cmd_cat(const char *name) {
         return;
     }
     
-    char tmp[4096];
-    int n = fs_read_file(name, tmp, sizeof(tmp)-1);
+    /* size the buffer to the file instead of capping it */
+    int fd = fs_open(name, FS_O_READ);
+    int size = fd >= 0 ? fs_fsize(fd) : -1;
+    char *tmp = size > 0 ? (char*)kmalloc(size + 1) : 0;
+    int n = tmp ? fs_pread(fd, 0, tmp, size) : -1;
+    if (fd >= 0) fs_close(fd);
     if (n <= 0) { 
-        ui_print_error("File not found or empty");
+        kfree(tmp);
+        ui_print_error(size > 0 && !tmp ? "Out of memory" : "File not found or empty");
         ui_print_footer();
         return;
     }
@@ -142,6 +161,7 @@ void cmd_cat(const char *name) {
     }
     
     ui_print_info("File size: %d bytes, %d lines", n, line_num);
+    kfree(tmp);
     ui_print_footer();
 }
 
@@ -184,9 +204,14 @@ void cmd_run(const char *name) {
     ui_print_info("Executing: %s", name);
     ui_print_divider('-');
     
-    if (fs_run(name) == 0) {
+    vmm_stats_t before, after;
+    vmm_get_stats(&before);
+    if (elf_run(name) == 0) {
+        vmm_get_stats(&after);
         ui_print_divider('-');
         ui_print_success("Program completed");
+        ui_print_info("%u pages faulted in, %u bytes read from disk",
+                      after.faults - before.faults, after.bytes_read - before.bytes_read);
     } else {
         ui_print_divider('-');
         ui_print_error("Failed to run program");
@@ -195,6 +220,46 @@ void cmd_run(const char *name) {
     ui_print_footer();
 }
 
+void cmd_spawn(const char *name) {
+    if (!name || name[0] == 0) {
+        ui_print_error("Usage: spawn <program>");
+        return;
+    }
+    char msg[64];
+    int tid = elf_spawn(name);
+    if (tid < 0) {
+        ui_print_error("Failed to start program");
+        return;
+    }
+    ksnprintf(msg, sizeof(msg), "Started %s as thread %d", name, tid);
+    ui_print_success(msg);
+}
+
+void cmd_ps(void) {
+    static const char *const states[] = { "unused", "ready", "running", "sleeping", "zombie" };
+    ui_print_header("THREADS");
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    printf_k("  %4s  %-9s %8s %6s  %s\n", "TID", "STATE", "CPU ms", "PAGES", "NAME");
+    thread_info_t ti;
+    int rc;
+    for (int i = 0; (rc = sched_get_info(i, &ti)) >= 0; i++) {
+        if (rc != 0) continue;
+        printf_k("  %4d  %-9s %8u %6u  %s\n", ti.tid, states[ti.state], ti.cpu_ms, ti.pages, ti.name);
+    }
+    ui_print_footer();
+}
+
+void cmd_kill(const char *arg) {
+    int tid = 0, digits = 0;
+    while (*arg >= '0' && *arg <= '9') tid = tid * 10 + (*arg++ - '0'), digits++;
+    if (!digits || *arg) {
+        ui_print_error("Usage: kill <tid>");
+        return;
+    }
+    if (thread_kill(tid) == 0) ui_print_success("Thread killed");
+    else ui_print_error("No such thread (the shell cannot be killed)");
+}
+
 void cmd_write(const char *name) {
     ui_print_header("CREATE FILE");
     
@@ -209,10 +274,19 @@ void cmd_write(const char *name) {
     printf_k("  Type your content below. To finish, enter '.' on a single line:\n");
     printf_k("  -------------------------------------------------------------\n");
     
+    /* each line is appended as it is entered, so saving costs only the
+       sectors the new line touches */
+    int fd = fs_open(name, FS_O_WRITE | FS_O_CREATE | FS_O_TRUNC);
+    if (fd < 0) {
+        ui_print_error("Failed to create file");
+        ui_print_footer();
+        return;
+    }
+
     char line[512];
-    char buf[4096];
     int off = 0;
     int lines = 0;
+    int ok = 1;
     
     while (1) {
         // Show line number prompt
@@ -220,29 +294,22 @@ void cmd_write(const char *name) {
         printf_k(" %3d │ ", lines + 1);
         vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
         
-        readline(line, sizeof(line));
+        readline(line, sizeof(line) - 1); /* leave room for the '\n' */
         
         if (line[0] == '.' && line[1] == 0) break;
         
-        // Copy line
-        int l = 0;
-        while (line[l]) {
-            if (off >= (int)sizeof(buf)-1) {
-                ui_print_warning("File size limit reached (4KB)");
-                break;
-            }
-            buf[off++] = line[l++];
+        int l = kstrlen(line);
+        line[l++] = '\n';
+        if (fs_append(fd, line, l) != l) {
+            ok = 0;
+            break;
         }
-        
-        if (off >= (int)sizeof(buf)-1) break;
-        
-        buf[off++] = '\n';
+        off += l;
         lines++;
     }
     
-    buf[off] = 0;
-    
-    if (fs_write_file(name, buf, off) == 0) {
+    if (fs_close(fd) != 0) ok = 0; /* an append that never reached the disk */
+    if (ok) {
         ui_print_success("File saved successfully");
         ui_print_info("Size: %d bytes, Lines: %d", off, lines);
     } else {
@@ -260,6 +327,10 @@ void cmd_help(void) {
     vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
     printf_k("    clear    - Clear the terminal screen\n");
     printf_k("    help     - Display this help message\n");
+    printf_k("    meminfo  - Show physical memory and allocator caches\n");
+    printf_k("    serial   - Mirror console to COM1 (serial on|off)\n");
+    printf_k("    trace    - Latency histograms (trace clear|on|off|export)\n");
+    printf_k("    bootprof - Show how long each boot phase took\n");
     printf_k("    exit     - Exit the shell (not implemented yet)\n\n");
     
     vga_set_color(UI_COLOR_HIGHLIGHT, COLOR_BLACK);
@@ -270,7 +341,12 @@ void cmd_help(void) {
     printf_k("    cat <f>  - Display file contents\n");
     printf_k("    write <f>- Create/edit a text file\n");
     printf_k("    rm <f>   - Remove a file (with confirmation)\n");
-    printf_k("    run <f>   - Execute a program\n\n");
+    printf_k("    run <f>   - Execute a program\n");
+    printf_k("    spawn <f>- Run a program in the background\n");
+    printf_k("    ps       - List threads\n");
+    printf_k("    kill <t> - Stop a background thread\n");
+    printf_k("    sync     - Flush cached filesystem metadata to disk\n");
+    printf_k("    fsstat   - Show filesystem cache/index statistics\n\n");
     
     vga_set_color(UI_COLOR_HIGHLIGHT, COLOR_BLACK);
     printf_k("  Applications:\n");
@@ -295,13 +371,168 @@ void cmd_sysinfo(void) {
     printf_k("  Version:         1.0.0\n");
     printf_k("  Terminal Size:   80x25\n");
     printf_k("  Cursor Position: %d,%d\n", x, y);
-    printf_k("  Filesystem:      FAT-like\n");
+    printf_k("  Filesystem:      BINO v%d (extents)\n", FS_VERSION);
     printf_k("  Memory:          ~640KB available\n");
     printf_k("  Processor:       386+ compatible\n");
     
     ui_print_footer();
 }
 
+void cmd_fsstat(void) {
+    ui_print_header("FILESYSTEM STATS");
+
+    bcache_stats_t cs;
+    bcache_get_stats(&cs);
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    printf_k("  Sector cache:    %d entries\n", BCACHE_ENTRIES);
+    printf_k("    hits:          %u\n", cs.hits);
+    printf_k("    misses:        %u\n", cs.misses);
+    printf_k("    writebacks:    %u\n", cs.writebacks);
+    printf_k("    evictions:     %u\n", cs.evictions);
+
+    fs_dir_stats_t ds;
+    fs_get_dir_stats(&ds);
+    printf_k("  Name index:      %d files\n", fs_count_files());
+    printf_k("    lookups:       %u\n", ds.lookups);
+    printf_k("    hits:          %u\n", ds.hits);
+    printf_k("    misses:        %u\n", ds.misses);
+    printf_k("    probes:        %u\n", ds.probes);
+
+    ui_print_footer();
+}
+
+void cmd_meminfo(void) {
+    ui_print_header("MEMORY");
+
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    uint32_t total = pmm_total_frames();
+    uint32_t free_frames = pmm_free_count();
+    printf_k("  Physical:  %u KB total, %u KB free (%u/%u frames)\n",
+             total * (PMM_FRAME_SIZE / 1024), free_frames * (PMM_FRAME_SIZE / 1024),
+             free_frames, total);
+
+    vga_set_color(UI_COLOR_HIGHLIGHT, COLOR_BLACK);
+    printf_k("  Object caches:\n");
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    kmem_cache_stats_t st;
+    for (int i = 0; kmem_cache_stats(i, &st) == 0; i++) {
+        /* fraction of the cache's pages not holding live objects */
+        uint32_t bytes = st.slabs * PMM_FRAME_SIZE;
+        uint32_t waste = bytes ? (bytes - st.active * st.obj_size) * 100 / bytes : 0;
+        printf_k("    %s (%u B): %u/%u in use, %u slabs, %u allocs, %u frees, %u%% unused\n",
+                 st.name, st.obj_size, st.active, st.capacity, st.slabs,
+                 st.allocs, st.frees, waste);
+    }
+
+    kmalloc_large_stats_t ls;
+    kmalloc_get_large_stats(&ls);
+    printf_k("    large: %u pages in use, %u allocs, %u frees\n", ls.pages, ls.allocs, ls.frees);
+
+    ui_print_footer();
+}
+
+/* render a TSC interval with a unit that keeps 1-4 significant digits */
+static void fmt_cycles(char *buf, int size, uint64_t c) {
+    uint32_t khz = trace_tsc_khz();
+    if (!khz) { ksnprintf(buf, size, "%ucyc", (uint32_t)c); return; }
+    if (c < (1u << 22)) {
+        uint32_t ns = (uint32_t)c * 1000 / khz;
+        if (ns < 10000) ksnprintf(buf, size, "%uns", ns);
+        else ksnprintf(buf, size, "%uus", ns / 1000);
+        return;
+    }
+    uint32_t mhz = khz / 1000 ? khz / 1000 : 1;
+    uint32_t us = (c >> 32) ? ((uint32_t)(c >> 8) / mhz) << 8 : (uint32_t)c / mhz;
+    if (us < 10000) ksnprintf(buf, size, "%uus", us);
+    else ksnprintf(buf, size, "%ums", us / 1000);
+}
+
+void cmd_trace(const char *arg) {
+    if (!trace_tsc_khz()) trace_init(); /* fastboot leaves calibration for later */
+    if (kstrcmp(arg, "clear") == 0) { trace_clear(); ui_print_success("Trace cleared"); return; }
+    if (kstrcmp(arg, "on") == 0) { trace_set_enabled(1); ui_print_success("Tracing on"); return; }
+    if (kstrcmp(arg, "off") == 0) { trace_set_enabled(0); ui_print_success("Tracing off"); return; }
+    if (kstrcmp(arg, "export") == 0) {
+        ui_print_info("Sending trace to COM1...");
+        trace_export_serial();
+        ui_print_success("Trace exported");
+        return;
+    }
+    if (*arg) { ui_print_error("Usage: trace [clear|on|off|export]"); return; }
+
+    ui_print_header("TRACE");
+    vga_set_color(UI_COLOR_HIGHLIGHT, COLOR_BLACK);
+    printf_k("  %-16s %8s %9s %9s %9s\n", "event", "count", "p50", "p99", "max");
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    for (uint16_t id = 0; id < TRACE_NUM_IDS; id++) {
+        trace_stats_t st;
+        if (trace_get_stats(id, &st) != 0 || st.count == 0) continue;
+        char name[16], p50[12], p99[12], max[12];
+        fmt_cycles(p50, sizeof(p50), st.p50);
+        fmt_cycles(p99, sizeof(p99), st.p99);
+        fmt_cycles(max, sizeof(max), st.max);
+        printf_k("  %-16s %8u %9s %9s %9s\n", trace_name(id, name, sizeof(name)),
+                 st.count, p50, p99, max);
+    }
+    printf_k("  TSC %u kHz, tracing %s\n", trace_tsc_khz(), trace_enabled() ? "on" : "off");
+    ui_print_footer();
+}
+
+// ========== BOOT PROFILE ==========
+/* kernel_main closes each boot phase with boot_mark(); the TSC works
+   before the timer exists and is converted once it has been calibrated */
+#define BOOT_MAX_PHASES 16
+static struct {
+    const char *name;
+    uint64_t end;
+} boot_phases[BOOT_MAX_PHASES];
+static int boot_nphases;
+static uint64_t boot_start;
+static const char *boot_cmdline;
+
+static void boot_mark(const char *name) {
+    if (boot_nphases == BOOT_MAX_PHASES) return;
+    boot_phases[boot_nphases].name = name;
+    boot_phases[boot_nphases].end = trace_now();
+    boot_nphases++;
+}
+
+/* is 'opt' one of the space-separated words on the kernel command line? */
+static int cmdline_has(const char *opt) {
+    const char *p = boot_cmdline;
+    size_t n = kstrlen(opt);
+    while (p && *p) {
+        while (*p == ' ') p++;
+        const char *w = p;
+        while (*p && *p != ' ') p++;
+        if ((size_t)(p - w) == n && kstrncmp(w, opt, n) == 0) return 1;
+    }
+    return 0;
+}
+
+void cmd_bootprof(void) {
+    if (!trace_tsc_khz()) trace_init(); /* fastboot leaves calibration for later */
+    ui_print_header("BOOT PROFILE");
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    char t[12];
+    fmt_cycles(t, sizeof(t), boot_start);
+    printf_k("  %-16s %9s\n", "before kernel", t);
+    uint64_t prev = boot_start;
+    for (int i = 0; i < boot_nphases; i++) {
+        fmt_cycles(t, sizeof(t), boot_phases[i].end - prev);
+        printf_k("  %-16s %9s\n", boot_phases[i].name, t);
+        prev = boot_phases[i].end;
+    }
+    if (boot_nphases) {
+        fmt_cycles(t, sizeof(t), boot_phases[boot_nphases - 1].end - boot_start);
+        vga_set_color(UI_COLOR_HIGHLIGHT, COLOR_BLACK);
+        printf_k("  %-16s %9s\n", "kernel total", t);
+    }
+    vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
+    printf_k("  cmdline: %s\n", boot_cmdline ? boot_cmdline : "(none)");
+    ui_print_footer();
+}
+
 // ========== ENHANCED CLI LOOP ==========
 void cli_loop() {
     char line[256];
@@ -339,6 +570,7 @@ void cli_loop() {
             ui_print_info("System shutting down...");
             ui_print_info("It is now safe to turn off your computer");
             ui_print_footer();
+            serial_flush();
             while(1) asm("hlt");  // Halt CPU
         }
         
@@ -379,6 +611,21 @@ void cli_loop() {
             cmd_run(cmd + 4); 
             continue; 
         }
+
+        if (kstrncmp(cmd, "spawn ", 6) == 0) {
+            cmd_spawn(cmd + 6);
+            continue;
+        }
+
+        if (kstrncmp(cmd, "ps", 2) == 0) {
+            cmd_ps();
+            continue;
+        }
+
+        if (kstrncmp(cmd, "kill ", 5) == 0) {
+            cmd_kill(cmd + 5);
+            continue;
+        }
         if (kstrncmp(cmd, "bmp ", 4) == 0) {
             /* draw BMP at top-lefnt */
             const char *fname = cmd + 4;
@@ -412,6 +659,44 @@ void cli_loop() {
             continue;
         }
         
+        if (kstrncmp(cmd, "fsstat", 6) == 0) {
+            cmd_fsstat();
+            continue;
+        }
+
+        if (kstrncmp(cmd, "meminfo", 7) == 0) {
+            cmd_meminfo();
+            continue;
+        }
+
+        if (kstrncmp(cmd, "bootprof", 8) == 0) {
+            cmd_bootprof();
+            continue;
+        }
+
+        if (kstrncmp(cmd, "trace", 5) == 0) {
+            const char *arg = cmd + 5;
+            while (*arg == ' ') arg++;
+            cmd_trace(arg);
+            continue;
+        }
+
+        if (kstrncmp(cmd, "serial", 6) == 0) {
+            const char *arg = cmd + 6;
+            while (*arg == ' ') arg++;
+            if (kstrcmp(arg, "on") == 0) serial_set_mirror(1);
+            else if (kstrcmp(arg, "off") == 0) serial_set_mirror(0);
+            else if (*arg) { ui_print_error("Usage: serial on|off"); continue; }
+            ui_print_info("Serial mirror is %s", serial_mirror_enabled() ? "on" : "off");
+            continue;
+        }
+
+        if (kstrncmp(cmd, "sync", 4) == 0) {
+            if (fs_sync() == 0) ui_print_success("Filesystem synced");
+            else ui_print_error("Failed to sync filesystem");
+            continue;
+        }
+
         if (kstrncmp(cmd, "sysinfo", 7) == 0 || kstrncmp(cmd, "info", 4) == 0) {
             cmd_sysinfo();
             continue;
@@ -427,6 +712,15 @@ void cli_loop() {
 
 // ========== ENHANCED KERNEL MAIN ==========
 void kernel_main(uint32_t magic, uint32_t addr) {
+    boot_start = trace_now();
+    kmem_init();
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && addr) {
+        multiboot_info_t *mbi = (multiboot_info_t*)addr;
+        if (mbi->flags & MULTIBOOT_INFO_CMDLINE) boot_cmdline = (const char*)mbi->cmdline;
+    }
+    /* fastboot: no banner, dots or logo, and no TSC calibration until needed */
+    int fastboot = cmdline_has("fastboot");
+
     // Initialize with black background
     vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
     vga_clear();
@@ -435,28 +729,58 @@ void kernel_main(uint32_t magic, uint32_t addr) {
     char fbmsg[64]; fb_status(fbmsg, sizeof(fbmsg));
     vga_set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
     printf_k("  %s\n", fbmsg);
+    boot_mark("fb_init");
     
     // Show animated boot sequence
-    ui_print_banner();
+    if (!fastboot) {
+        ui_print_banner();
+        boot_mark("banner");
+    }
     
-    vga_set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
+    /* interrupts and the PIT come first so boot delays are timer-paced */
+    ui_print_info("Setting up interrupts...");
+    gdt_init();
+    idt_init();
+    irq_init();
+    timer_init();
+    kbd_init();
+    serial_init(SERIAL_COM1);
+    sched_init();
+    asm volatile ("sti");
+    if (cmdline_has("console=serial")) serial_set_mirror(1);
+    boot_mark("idt_init");
 
-    for(int i = 0; i < 3; i++) {
-        putc_k('.');
-        // Small delay (you might need to implement delay function)
-        for(int j = 0; j < 1000000; j++) asm("nop");
+    if (!fastboot) {
+        trace_init();
+        boot_mark("tsc calibrate");
+
+        vga_set_color(COLOR_LIGHT_GREEN, COLOR_BLACK);
+        for(int i = 0; i < 3; i++) {
+            putc_k('.');
+            ksleep_ms(150);
+        }
+        putc_k('\n');
+        boot_mark("boot delay");
     }
-    putc_k('\n');
     
     // Initialize subsystems
+    ui_print_info("Initializing memory...");
+    pmm_init(magic, addr);
+    if (elf_init() != 0) ui_print_error("Not enough RAM for the user program region");
+    if (vmm_init() != 0) ui_print_error("CPU has no 4 MB pages; programs cannot run");
+    ui_print_info("%d KB free RAM", (int)(pmm_free_count() * (PMM_FRAME_SIZE / 1024)));
+    boot_mark("pmm_init");
+
     ui_print_info("Loading ATA driver...");
     ata_init();
-    
-    ui_print_info("Setting up interrupts...");
-    idt_init();
+    boot_mark("ata_init");
     
     ui_print_info("Mounting filesystem...");
-    if (fs_init() != 0) {
+    int fs_rc = fs_init();
+    if (fs_rc == -2) {
+        ui_print_error("Unsupported filesystem version!");
+        ui_print_info("Re-create the disk image with the current mkfs");
+    } else if (fs_rc != 0) {
         ui_print_error("Filesystem not found!");
         ui_print_info("Please run mkfs on disk image first");
     } else {
@@ -466,22 +790,34 @@ void kernel_main(uint32_t magic, uint32_t addr) {
         int file_count = fs_count_files();
         ui_print_info("%d files found in root directory", file_count);
     }
+    boot_mark("fs mount");
     
     // Display logo if  dexists
-    char logo_buffer[2048];
-    if (fs_read_file("logo.txt", logo_buffer, sizeof(logo_buffer)-1) > 0) {
-        ui_print_divider('=');
-        logo_buffer[sizeof(logo_buffer)-1] = 0;
-        
-        // Display logo in a different color
-        vga_set_color(COLOR_CYAN, COLOR_BLACK);
-        printf_k("%s\n", logo_buffer);
-        ui_print_divider('=');
+    if (!fastboot && fs_rc == 0) {
+        char logo_buffer[2048];
+        int n = fs_read_file("logo.txt", logo_buffer, sizeof(logo_buffer)-1);
+        if (n > 0) {
+            ui_print_divider('=');
+            logo_buffer[n] = 0;
+            
+            // Display logo in a different color
+            vga_set_color(COLOR_CYAN, COLOR_BLACK);
+            printf_k("%s\n", logo_buffer);
+            ui_print_divider('=');
+        }
+        boot_mark("logo");
     }
     
     // Boot complete message
     vga_set_color(COLOR_GREEN, COLOR_BLACK);
-    printf_k("\n  System ready. Type 'help' to begin.\n\n");
+    printf_k("\n  System ready. Type 'help' to begin.\n");
+    boot_mark("cli ready");
+    if (trace_tsc_khz()) {
+        char t[12];
+        fmt_cycles(t, sizeof(t), boot_phases[boot_nphases - 1].end - boot_start);
+        printf_k("  Booted in %s ('bootprof' for details)\n", t);
+    }
+    printf_k("\n");
     
     // Reset to normal text color
     vga_set_color(UI_COLOR_TEXT, COLOR_BLACK);
@@ -0,0 +1,164 @@
+// === FILE: kformat.c ===
+#include "kformat.h"
+#include "kstring.h"
+
+typedef struct {
+    kfmt_sink_t *sink;
+    char buf[KFMT_CHUNK];
+    int len;
+    int total;
+} kfmt_out_t;
+
+static void out_flush(kfmt_out_t *o) {
+    if (o->len) o->sink->write(o->sink, o->buf, o->len);
+    o->len = 0;
+}
+static void out_char(kfmt_out_t *o, char c) {
+    if (o->len == KFMT_CHUNK) out_flush(o);
+    o->buf[o->len++] = c;
+    o->total++;
+}
+static void out_str(kfmt_out_t *o, const char *s, int n) {
+    while (n-- > 0) out_char(o, *s++);
+}
+static void out_pad(kfmt_out_t *o, char c, int n) {
+    while (n-- > 0) out_char(o, c);
+}
+
+int kvformat(kfmt_sink_t *sink, const char *fmt, va_list ap) {
+    kfmt_out_t o;
+    o.sink = sink; o.len = 0; o.total = 0;
+    while (*fmt) {
+        if (*fmt != '%') { out_char(&o, *fmt++); continue; }
+        const char *spec = fmt++;
+        int left = 0, zero = 0, alt = 0, plus = 0, space = 0;
+        for (;; fmt++) {
+            if (*fmt == '-') left = 1;
+            else if (*fmt == '0') zero = 1;
+            else if (*fmt == '#') alt = 1;
+            else if (*fmt == '+') plus = 1;
+            else if (*fmt == ' ') space = 1;
+            else break;
+        }
+        int width = 0;
+        if (*fmt == '*') {
+            width = va_arg(ap, int);
+            if (width < 0) { left = 1; width = -width; }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        }
+        int prec = -1;
+        if (*fmt == '.') {
+            fmt++;
+            prec = 0;
+            if (*fmt == '*') { prec = va_arg(ap, int); fmt++; }
+            else while (*fmt >= '0' && *fmt <= '9') prec = prec * 10 + (*fmt++ - '0');
+        }
+        while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') fmt++;
+        char conv = *fmt;
+        if (!conv) { out_str(&o, spec, (int)(fmt - spec)); break; }
+        fmt++;
+        switch (conv) {
+            case '%':
+                out_char(&o, '%');
+                break;
+            case 'c': {
+                char c = (char)va_arg(ap, int);
+                if (!left) out_pad(&o, ' ', width - 1);
+                out_char(&o, c);
+                if (left) out_pad(&o, ' ', width - 1);
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                int n = 0;
+                while (s[n] && (prec < 0 || n < prec)) n++;
+                if (!left) out_pad(&o, ' ', width - n);
+                out_str(&o, s, n);
+                if (left) out_pad(&o, ' ', width - n);
+                break;
+            }
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'p': {
+                const char *digits = "0123456789abcdef";
+                const char *prefix = "";
+                char sign = 0;
+                uint32_t base = 10, v;
+                if (conv == 'd' || conv == 'i') {
+                    int32_t sv = va_arg(ap, int32_t);
+                    v = sv < 0 ? 0u - (uint32_t)sv : (uint32_t)sv;
+                    if (sv < 0) sign = '-';
+                    else if (plus) sign = '+';
+                    else if (space) sign = ' ';
+                } else if (conv == 'p') {
+                    v = (uint32_t)(uintptr_t)va_arg(ap, void*);
+                    base = 16;
+                    prefix = "0x";
+                    if (prec < 0) prec = 8;
+                } else {
+                    v = va_arg(ap, uint32_t);
+                    if (conv == 'o') base = 8;
+                    else if (conv != 'u') base = 16;
+                    if (conv == 'X') digits = "0123456789ABCDEF";
+                    if (alt && v) prefix = conv == 'o' ? "0" : conv == 'X' ? "0X" : conv == 'x' ? "0x" : "";
+                }
+                char tmp[12];
+                int n = 0;
+                while (v) { tmp[n++] = digits[v % base]; v /= base; }
+                if (n == 0 && prec < 0) tmp[n++] = '0';
+                int plen = (int)kstrlen(prefix) + (sign != 0);
+                int zeros = prec > n ? prec - n : 0;
+                int pad = width - plen - zeros - n;
+                if (zero && !left && prec < 0 && pad > 0) { zeros += pad; pad = 0; }
+                if (!left) out_pad(&o, ' ', pad);
+                if (sign) out_char(&o, sign);
+                out_str(&o, prefix, (int)kstrlen(prefix));
+                out_pad(&o, '0', zeros);
+                while (n--) out_char(&o, tmp[n]);
+                if (left) out_pad(&o, ' ', pad);
+                break;
+            }
+            default:
+                /* unknown conversion, print it verbatim */
+                out_str(&o, spec, (int)(fmt - spec));
+                break;
+        }
+    }
+    out_flush(&o);
+    return o.total;
+}
+
+/* memory sink: copy what fits and keep room for the terminator */
+typedef struct {
+    kfmt_sink_t sink;
+    char *buf;
+    int size;
+    int pos;
+} kfmt_mem_t;
+
+static void mem_write(kfmt_sink_t *sink, const char *s, int len) {
+    kfmt_mem_t *m = (kfmt_mem_t*)sink;
+    int room = m->size - 1 - m->pos;
+    if (len > room) len = room;
+    if (len <= 0) return;
+    kmemcpy(m->buf + m->pos, s, (size_t)len);
+    m->pos += len;
+}
+
+int kvsnprintf(char *buf, int size, const char *fmt, va_list ap) {
+    kfmt_mem_t m;
+    m.sink.write = mem_write;
+    m.buf = buf; m.size = size; m.pos = 0;
+    int n = kvformat(&m.sink, fmt, ap);
+    if (size > 0) buf[m.pos] = '\0';
+    return n;
+}
+
+int ksnprintf(char *buf, int size, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
@@ -0,0 +1,31 @@
+#ifndef KFORMAT_H
+#define KFORMAT_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+/* printf-style formatter shared by every output path. Text is collected
+   in a small chunk and handed to the sink's write() a chunk at a time,
+   so a sink pays one call per chunk instead of one per character.
+
+   Supported: %d %i %u %x %X %o %c %s %p %%, the flags - 0 # + and space,
+   field width and precision (both may be *), and the l/h/z length
+   modifiers, which are accepted and ignored since long is 32 bits here. */
+
+#define KFMT_CHUNK 64
+
+typedef struct kfmt_sink kfmt_sink_t;
+struct kfmt_sink {
+    /* embed this as the first member of a larger struct to carry state */
+    void (*write)(kfmt_sink_t *sink, const char *s, int len);
+};
+
+/* format into sink; returns the number of characters produced */
+int kvformat(kfmt_sink_t *sink, const char *fmt, va_list ap);
+
+/* format into buf, always NUL-terminated when size > 0; returns the
+   length the full output would have had */
+int kvsnprintf(char *buf, int size, const char *fmt, va_list ap);
+int ksnprintf(char *buf, int size, const char *fmt, ...);
+
+#endif // KFORMAT_H
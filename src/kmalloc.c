@@ -0,0 +1,78 @@
+/* kmalloc.c - general-purpose heap built from object caches.
+   Small requests are rounded up to a power of two and served by one of
+   the kmalloc-16 .. kmalloc-2048 caches, created on first use. Larger
+   requests take ceil((size + header) / 4 KB) contiguous frames with a
+   small header in front, so kfree can tell the two apart by looking at
+   the start of the pointer's page.
+*/
+
+#include "kmalloc.h"
+#include "slab.h"
+#include "pmm.h"
+#include "kstring.h"
+#include <stdint.h>
+
+#define LARGE_MAGIC 0x1A26E000u
+#define NUM_CLASSES 8 /* 16, 32, ..., 2048 */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t pages;
+    uint32_t pad[2]; /* keep the payload 16-byte aligned */
+} large_hdr_t;
+
+static kmem_cache_t *classes[NUM_CLASSES];
+static kmalloc_large_stats_t large_stats;
+
+static kmem_cache_t *class_cache(size_t size) {
+    int cls = 0;
+    uint32_t obj = KMALLOC_MIN_SLAB;
+    while (obj < size) { obj <<= 1; cls++; }
+    if (!classes[cls]) {
+        static const char *names[NUM_CLASSES] = {
+            "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+            "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+        };
+        classes[cls] = kmem_cache_create(names[cls], obj, 0);
+    }
+    return classes[cls];
+}
+
+void *kmalloc(size_t size) {
+    if (size == 0) return 0;
+    if (size <= KMALLOC_MAX_SLAB) return kmem_cache_alloc(class_cache(size));
+
+    uint32_t pages = (size + sizeof(large_hdr_t) + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint32_t base = pmm_alloc_frames(pages);
+    if (!base) return 0;
+    large_hdr_t *h = (large_hdr_t*)(uintptr_t)base;
+    h->magic = LARGE_MAGIC;
+    h->pages = pages;
+    large_stats.allocs++;
+    large_stats.pages += pages;
+    return h + 1;
+}
+
+void *kzalloc(size_t size) {
+    void *p = kmalloc(size);
+    if (p) kmemset(p, 0, size);
+    return p;
+}
+
+void kfree(void *ptr) {
+    if (!ptr) return;
+    uint32_t page = (uint32_t)(uintptr_t)ptr & ~(PMM_FRAME_SIZE - 1);
+    large_hdr_t *h = (large_hdr_t*)(uintptr_t)page;
+    if (h->magic == LARGE_MAGIC && (void*)(h + 1) == ptr) {
+        h->magic = 0;
+        large_stats.frees++;
+        large_stats.pages -= h->pages;
+        pmm_free_frames(page, h->pages);
+        return;
+    }
+    kmem_cache_free(kmem_cache_of(ptr), ptr);
+}
+
+void kmalloc_get_large_stats(kmalloc_large_stats_t *out) {
+    if (out) *out = large_stats;
+}
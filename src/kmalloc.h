@@ -0,0 +1,25 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel heap on top of the page-frame allocator. Requests up to
+   KMALLOC_MAX_SLAB bytes come from the power-of-two "kmalloc-N" object
+   caches (see slab.h); larger ones get their own run of pages. */
+
+#define KMALLOC_MIN_SLAB 16
+#define KMALLOC_MAX_SLAB 2048
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t pages; /* pages currently held by large allocations */
+} kmalloc_large_stats_t;
+
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void kfree(void *ptr);
+void kmalloc_get_large_stats(kmalloc_large_stats_t *out);
+
+#endif
@@ -36,21 +36,179 @@ char *kstrncpy(char *dst, const char *src, size_t n) {
     return dst;
 }
 
-void *kmemset(void *s, int c, size_t n) {
-    unsigned char *p = s;
-    while (n--) *p++ = (unsigned char)c;
-    return s;
+/* ---------- mem* primitives ----------
+   Copies and fills align the destination, then move 32-bit words with
+   rep movsl / rep stosl and finish the tail bytewise. Blocks of at least
+   KMEM_SSE_MIN bytes use 16-byte SSE2 moves once kmem_init() has found
+   SSE2. Each SSE block saves the XMM state it finds with fxsave and puts
+   it back with fxrstor: the registers may belong to a program that made
+   a syscall, or to an outer copy that took a page fault whose handler
+   copies too. Masking interrupts would not cover either case. */
+
+#define KMEM_SSE_MIN 4096 /* below this the fxsave/fxrstor pair costs more than it saves */
+
+static int kmem_sse2;
+
+void kmem_init(void) {
+    uint32_t a = 1, b, c = 0, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    if (!(d & (1u << 26))) return;
+#ifndef KSTRING_HOST
+    /* CR0: EM off, MP on; CR4: OSFXSR and OSXMMEXCPT on */
+    uint32_t cr;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr));
+    cr = (cr & ~(1u << 2)) | (1u << 1);
+    __asm__ volatile ("mov %0, %%cr0" :: "r"(cr));
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr));
+    cr |= (1u << 9) | (1u << 10);
+    __asm__ volatile ("mov %0, %%cr4" :: "r"(cr));
+#endif
+    kmem_sse2 = 1;
+}
+
+int kmem_has_sse2(void) {
+    return kmem_sse2;
+}
+
+/* fxsave image; 'raw' is aligned by hand because nothing guarantees
+   the kernel stacks are 16-byte aligned */
+typedef struct {
+    uint8_t raw[512 + 15];
+} sse_save_t;
+
+static inline uint8_t *sse_area(sse_save_t *sv) {
+    return (uint8_t*)(((uintptr_t)sv->raw + 15) & ~(uintptr_t)15);
+}
+
+static inline void sse_begin(sse_save_t *sv) {
+    __asm__ volatile ("fxsave (%0)" :: "r"(sse_area(sv)) : "memory");
+}
+
+static inline void sse_end(sse_save_t *sv) {
+    __asm__ volatile ("fxrstor (%0)" :: "r"(sse_area(sv)) : "memory");
+}
+
+/* d must be 16-byte aligned; copies blocks * 64 bytes. Built for SSE2
+   on its own so the rest of the kernel stays free of SSE code. */
+__attribute__((target("sse2"), noinline))
+static void sse_copy64(uint8_t *d, const uint8_t *s, size_t blocks) {
+    if (!blocks) return;
+    sse_save_t sv;
+    sse_begin(&sv);
+    __asm__ volatile (
+        "1:\n\t"
+        "movdqu   (%1), %%xmm0\n\t"
+        "movdqu 16(%1), %%xmm1\n\t"
+        "movdqu 32(%1), %%xmm2\n\t"
+        "movdqu 48(%1), %%xmm3\n\t"
+        "movdqa %%xmm0,   (%0)\n\t"
+        "movdqa %%xmm1, 16(%0)\n\t"
+        "movdqa %%xmm2, 32(%0)\n\t"
+        "movdqa %%xmm3, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "add $64, %1\n\t"
+        "dec %2\n\t"
+        "jnz 1b"
+        : "+r"(d), "+r"(s), "+r"(blocks)
+        :: "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+    sse_end(&sv);
+}
+
+/* d must be 16-byte aligned; fills blocks * 64 bytes with pat */
+__attribute__((target("sse2"), noinline))
+static void sse_fill64(uint8_t *d, uint32_t pat, size_t blocks) {
+    if (!blocks) return;
+    sse_save_t sv;
+    sse_begin(&sv);
+    /* the pattern is spread inside the asm, so no XMM register is
+       touched before the fxsave */
+    __asm__ volatile (
+        "movd %2, %%xmm0\n\t"
+        "pshufd $0, %%xmm0, %%xmm0\n\t"
+        "1:\n\t"
+        "movdqa %%xmm0,   (%0)\n\t"
+        "movdqa %%xmm0, 16(%0)\n\t"
+        "movdqa %%xmm0, 32(%0)\n\t"
+        "movdqa %%xmm0, 48(%0)\n\t"
+        "add $64, %0\n\t"
+        "dec %1\n\t"
+        "jnz 1b"
+        : "+r"(d), "+r"(blocks)
+        : "r"(pat)
+        : "memory", "cc", "xmm0");
+    sse_end(&sv);
 }
 
 void *kmemcpy(void *dest, const void *src, size_t n) {
-    unsigned char *d = dest; const unsigned char *s = src;
-    while (n--) *d++ = *s++;
+    uint8_t *d = dest;
+    const uint8_t *s = src;
+    if (n >= KMEM_SSE_MIN && kmem_sse2) {
+        size_t head = (size_t)(-(uintptr_t)d & 15);
+        n -= head;
+        __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(head) :: "memory");
+        sse_copy64(d, s, n / 64);
+        d += n & ~(size_t)63;
+        s += n & ~(size_t)63;
+        n &= 63;
+    }
+    if (n >= 8) {
+        size_t head = (size_t)(-(uintptr_t)d & 3);
+        n -= head;
+        __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(head) :: "memory");
+        size_t words = n / 4;
+        n &= 3;
+        __asm__ volatile ("rep movsl" : "+D"(d), "+S"(s), "+c"(words) :: "memory");
+    }
+    __asm__ volatile ("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
     return dest;
 }
 
+void *kmemset(void *dst, int c, size_t n) {
+    uint8_t *d = dst;
+    uint32_t pat = (uint8_t)c * 0x01010101u;
+    if (n >= KMEM_SSE_MIN && kmem_sse2) {
+        size_t head = (size_t)(-(uintptr_t)d & 15);
+        n -= head;
+        __asm__ volatile ("rep stosb" : "+D"(d), "+c"(head) : "a"(pat) : "memory");
+        sse_fill64(d, pat, n / 64);
+        d += n & ~(size_t)63;
+        n &= 63;
+    }
+    if (n >= 8) {
+        size_t head = (size_t)(-(uintptr_t)d & 3);
+        n -= head;
+        __asm__ volatile ("rep stosb" : "+D"(d), "+c"(head) : "a"(pat) : "memory");
+        size_t words = n / 4;
+        n &= 3;
+        __asm__ volatile ("rep stosl" : "+D"(d), "+c"(words) : "a"(pat) : "memory");
+    }
+    __asm__ volatile ("rep stosb" : "+D"(d), "+c"(n) : "a"(pat) : "memory");
+    return dst;
+}
+
+typedef uint32_t __attribute__((may_alias, aligned(1))) kmem_word_t;
+
 int kmemcmp(const void *a, const void *b, size_t n) {
     const unsigned char *pa = a, *pb = b;
-    for (size_t i=0;i<n;i++) if (pa[i] != pb[i]) return pa[i]-pb[i];
+    /* skip the equal prefix a word at a time, then find the byte */
+    while (n >= 4 && *(const kmem_word_t*)pa == *(const kmem_word_t*)pb) {
+        pa += 4; pb += 4; n -= 4;
+    }
+    for (size_t i = 0; i < n; i++) if (pa[i] != pb[i]) return pa[i] - pb[i];
     return 0;
 }
 
+#ifndef KSTRING_HOST
+/* gcc emits calls to these for struct copies and large initialisers */
+void *memcpy(void *dest, const void *src, size_t n) {
+    return kmemcpy(dest, src, n);
+}
+
+void *memset(void *s, int c, size_t n) {
+    return kmemset(s, c, n);
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    return kmemcmp(a, b, n);
+}
+#endif
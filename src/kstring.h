@@ -4,12 +4,16 @@
 #define KSTRING_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 size_t kstrlen(const char *s);
 int kstrcmp(const char *a, const char *b);
 int kstrncmp(const char *a, const char *b, size_t n);
 char *kstrcpy(char *dst, const char *src);
 char *kstrncpy(char *dst, const char *src, size_t n);
+/* probe CPUID and enable SSE2 for the large-block mem* paths; call once at boot */
+void kmem_init(void);
+int kmem_has_sse2(void);
 void *kmemset(void *s, int c, size_t n);
 void *kmemcpy(void *dest, const void *src, size_t n);
 int kmemcmp(const void *a, const void *b, size_t n);
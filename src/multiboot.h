@@ -0,0 +1,49 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+/* Multiboot v1 boot information, as handed over in EBX */
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+/* multiboot_info_t.flags bits */
+#define MULTIBOOT_INFO_MEMORY  0x001 /* mem_lower/mem_upper valid */
+#define MULTIBOOT_INFO_CMDLINE 0x004 /* cmdline valid */
+#define MULTIBOOT_INFO_MMAP    0x040 /* mmap_addr/mmap_length valid */
+
+typedef struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+    uint32_t vbe_control_info;
+    uint32_t vbe_mode;
+    uint32_t vbe_interface_seg;
+    uint32_t vbe_interface_off;
+    uint32_t vbe_interface_len;
+} multiboot_info_t;
+
+/* One memory map record. 'size' does not count itself, so the next record
+   starts at (uint8_t*)entry + entry->size + 4. */
+typedef struct {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+#endif
@@ -0,0 +1,154 @@
+/* pmm.c - bitmap page-frame allocator.
+   Every frame starts out "used"; pmm_init then frees the frames the
+   Multiboot memory map reports as available RAM, and finally re-reserves
+   low memory (BIOS, VGA, boot structures) and the kernel image itself.
+   Allocation skips full bitmap words and starts from a rotating hint.
+*/
+
+#include "pmm.h"
+#include "multiboot.h"
+#include "kstring.h"
+#include <stdint.h>
+
+#define PMM_WORDS (PMM_MAX_FRAMES / 32)
+
+extern char __bss_end[]; /* end of the kernel image, from linker.ld */
+
+static uint32_t frame_map[PMM_WORDS]; /* bit set => frame in use */
+static uint32_t frames_total;         /* frames backed by usable RAM */
+static uint32_t frames_free;
+static uint32_t frame_limit;          /* one past the highest usable frame */
+static uint32_t next_hint;            /* frame to start the next search at */
+
+static inline int frame_used(uint32_t f) {
+    return (frame_map[f / 32] >> (f & 31)) & 1;
+}
+
+static void mark_range(uint32_t first, uint32_t count, int used) {
+    for (uint32_t f = first; f < first + count && f < PMM_MAX_FRAMES; f++) {
+        uint32_t bit = 1u << (f & 31);
+        if (used && !(frame_map[f / 32] & bit)) {
+            frame_map[f / 32] |= bit;
+            frames_free--;
+        } else if (!used && (frame_map[f / 32] & bit)) {
+            frame_map[f / 32] &= ~bit;
+            frames_free++;
+        }
+    }
+}
+
+/* release the whole frames inside [base, base+len), clipped to 1 GB */
+static void add_region(uint64_t base, uint64_t len) {
+    uint64_t end = base + len;
+    if (end > PMM_MAX_MEMORY) end = PMM_MAX_MEMORY;
+    uint64_t first = (base + PMM_FRAME_SIZE - 1) / PMM_FRAME_SIZE;
+    uint64_t last = end / PMM_FRAME_SIZE;
+    if (last <= first) return;
+    mark_range((uint32_t)first, (uint32_t)(last - first), 0);
+    frames_total += (uint32_t)(last - first);
+    if (last > frame_limit) frame_limit = (uint32_t)last;
+}
+
+void pmm_reserve(uint32_t addr, uint32_t len) {
+    if (len == 0) return;
+    uint32_t first = addr / PMM_FRAME_SIZE;
+    uint32_t last = (addr + len - 1) / PMM_FRAME_SIZE;
+    mark_range(first, last - first + 1, 1);
+}
+
+void pmm_init(uint32_t magic, uint32_t addr) {
+    for (uint32_t i = 0; i < PMM_WORDS; i++) frame_map[i] = 0xFFFFFFFFu;
+    frames_total = frames_free = frame_limit = next_hint = 0;
+
+    const multiboot_info_t *mb = 0;
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && addr != 0)
+        mb = (const multiboot_info_t*)(uintptr_t)addr;
+
+    if (mb && (mb->flags & MULTIBOOT_INFO_MMAP)) {
+        uint32_t p = mb->mmap_addr;
+        uint32_t end = mb->mmap_addr + mb->mmap_length;
+        while (p < end) {
+            const multiboot_mmap_entry_t *e = (const multiboot_mmap_entry_t*)(uintptr_t)p;
+            if (e->type == MULTIBOOT_MEMORY_AVAILABLE) add_region(e->addr, e->len);
+            p += e->size + 4;
+        }
+    } else if (mb && (mb->flags & MULTIBOOT_INFO_MEMORY)) {
+        /* no map: conventional memory plus the contiguous block above 1 MB */
+        add_region(0, (uint64_t)mb->mem_lower * 1024);
+        add_region(0x100000, (uint64_t)mb->mem_upper * 1024);
+    } else {
+        /* nothing from the loader; assume the 16 MB every VM config has */
+        add_region(0x100000, 15 * 0x100000);
+    }
+
+    /* real-mode IVT/BDA, EBDA, VGA and BIOS ROMs, and the kernel image */
+    pmm_reserve(0, 0x100000);
+    pmm_reserve(0x100000, (uint32_t)(uintptr_t)__bss_end - 0x100000);
+    if (mb) {
+        /* keep the boot information readable for later users */
+        pmm_reserve(addr, sizeof(multiboot_info_t));
+        if (mb->flags & MULTIBOOT_INFO_MMAP) pmm_reserve(mb->mmap_addr, mb->mmap_length);
+        if (mb->flags & MULTIBOOT_INFO_CMDLINE)
+            pmm_reserve(mb->cmdline, (uint32_t)kstrlen((const char*)(uintptr_t)mb->cmdline) + 1);
+    }
+}
+
+uint32_t pmm_alloc_frame(void) {
+    return pmm_alloc_frames(1);
+}
+
+void pmm_free_frame(uint32_t addr) {
+    pmm_free_frames(addr, 1);
+}
+
+/* first free frame at or after 'f' (frame_limit if none); skips full words */
+static uint32_t next_free(uint32_t f) {
+    while (f < frame_limit) {
+        uint32_t free_bits = ~frame_map[f / 32] >> (f & 31);
+        if (free_bits) {
+            f += (uint32_t)__builtin_ctz(free_bits);
+            return f < frame_limit ? f : frame_limit;
+        }
+        f = (f | 31) + 1;
+    }
+    return frame_limit;
+}
+
+/* first-fit search for 'count' contiguous free frames in [from, to) */
+static uint32_t find_run(uint32_t from, uint32_t to, uint32_t count) {
+    uint32_t f = next_free(from);
+    while (f < to) {
+        uint32_t run = 0;
+        while (run < count && f + run < frame_limit && !frame_used(f + run)) run++;
+        if (run == count) return f;
+        f = next_free(f + run);
+    }
+    return frame_limit;
+}
+
+uint32_t pmm_alloc_frames(uint32_t count) {
+    if (count == 0 || count > frames_free) return 0;
+    /* start where the last allocation ended, then wrap around once */
+    uint32_t f = find_run(next_hint, frame_limit, count);
+    if (f >= frame_limit) f = find_run(0, next_hint, count);
+    if (f >= frame_limit) return 0;
+    mark_range(f, count, 1);
+    next_hint = f + count;
+    return f * PMM_FRAME_SIZE;
+}
+
+void pmm_free_frames(uint32_t addr, uint32_t count) {
+    if (addr % PMM_FRAME_SIZE) return;
+    uint32_t first = addr / PMM_FRAME_SIZE;
+    if (first < 0x100000 / PMM_FRAME_SIZE || first + count > frame_limit) return;
+    mark_range(first, count, 0);
+    if (first < next_hint) next_hint = first;
+}
+
+uint32_t pmm_total_frames(void) {
+    return frames_total;
+}
+
+uint32_t pmm_free_count(void) {
+    return frames_free;
+}
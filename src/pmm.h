@@ -0,0 +1,30 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+
+/* Physical page-frame allocator. One bit per 4 KB frame, built from the
+   Multiboot memory map; frames are reachable through the kernel's
+   identity map, so a frame address can be used directly as a pointer. */
+
+#define PMM_FRAME_SIZE  4096
+#define PMM_MAX_MEMORY  0x40000000u /* track at most the first 1 GB */
+#define PMM_MAX_FRAMES  (PMM_MAX_MEMORY / PMM_FRAME_SIZE)
+
+void pmm_init(uint32_t magic, uint32_t addr);
+
+/* single frames; 0 means out of memory */
+uint32_t pmm_alloc_frame(void);
+void pmm_free_frame(uint32_t addr);
+
+/* 'count' physically contiguous frames */
+uint32_t pmm_alloc_frames(uint32_t count);
+void pmm_free_frames(uint32_t addr, uint32_t count);
+
+/* mark [addr, addr+len) as in use, e.g. for memory-mapped devices */
+void pmm_reserve(uint32_t addr, uint32_t len);
+
+uint32_t pmm_total_frames(void);
+uint32_t pmm_free_count(void);
+
+#endif
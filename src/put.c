@@ -1,49 +1,55 @@
+/* put.c - host tool to copy a file into a disk image formatted by mkfs.
+   Usage: put disk.img file [name_in_fs]
+   Blocks are taken from as many free runs as needed (up to FS_MAX_EXTENTS),
+   matching the kernel's extent allocator. */
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include "fs_format.h"
 
-#define SECTOR 512
-#define FS_SUPER_LBA    1
-#define FS_BITMAP_LBA   2
-#define FS_BITMAP_SECTS 16
-#define FS_ROOT_LBA     (FS_BITMAP_LBA + FS_BITMAP_SECTS)
-#define FS_ROOT_SECTS   8
-#define FS_DATA_LBA     (FS_ROOT_LBA + FS_ROOT_SECTS)
+#define SECTOR FS_SECTOR
 
-struct DirEntry {
-    char name[16];
-    uint32_t size;
-    uint32_t start;
-    uint32_t blocks;
-};
+static uint8_t bitmap[FS_BITMAP_SECTS * SECTOR];
+static fs_dirent_t dir[FS_MAX_FILES];
+static uint32_t total_blocks;
 
-uint8_t bitmap[FS_BITMAP_SECTS * 512];
+static int bit_used(uint32_t b) { return bitmap[b / 8] & (1 << (b % 8)); }
 
 static void set_bitmap(uint32_t block)
 {
-    bitmap[block / 8] |= (1 << (block % 8));
+    uint32_t b = block - FS_DATA_LBA;
+    bitmap[b / 8] |= (1 << (b % 8));
 }
 
-static int find_free_blocks(int need, uint32_t *start)
+/* first-fit over free runs; returns extent count or -1 */
+static int alloc_extents(uint32_t need, fs_extent_t *ext)
 {
-    int count = 0;
-    for (uint32_t i = FS_DATA_LBA; i < 100000; i++) {
-        uint32_t byte = i / 8;
-        uint32_t bit = i % 8;
-        if (!(bitmap[byte] & (1 << bit))) {
-            if (count == 0) *start = i;
-            count++;
-            if (count == need) return 1;
-        } else count = 0;
+    int n = 0;
+    uint32_t b = 0;
+    while (need > 0) {
+        while (b < total_blocks && bit_used(b)) b++;
+        if (b >= total_blocks || n == FS_MAX_EXTENTS) return -1;
+        uint32_t start = b;
+        while (b < total_blocks && !bit_used(b) && b - start < need) b++;
+        ext[n].start = FS_DATA_LBA + start;
+        ext[n].count = b - start;
+        need -= ext[n].count;
+        n++;
     }
-    return 0;
+    return n;
+}
+
+static int write_at(FILE *img, uint32_t lba, const void *buf, size_t len)
+{
+    if (fseek(img, (long)lba * SECTOR, SEEK_SET)) return -1;
+    return fwrite(buf, 1, len, img) == len ? 0 : -1;
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 3) {
-        printf("Usage: put disk.img file\n");
+        printf("Usage: put disk.img file [name]\n");
         return 1;
     }
 
@@ -53,19 +59,42 @@ int main(int argc, char **argv)
     FILE *in = fopen(argv[2], "rb");
     if (!in) { perror("open input"); return 1; }
 
+    const char *name = argv[3];
+    if (!name) {
+        name = strrchr(argv[2], '/');
+        name = name ? name + 1 : argv[2];
+    }
+    if (strlen(name) >= FS_FILENAME_MAX) { printf("Name too long\n"); return 1; }
+
+    fs_super_t sb;
+    fseek(img, FS_SUPER_LBA * SECTOR, SEEK_SET);
+    if (fread(&sb, sizeof(sb), 1, img) != 1 || sb.magic != FS_MAGIC) {
+        printf("Not a Binod OS image (run mkfs)\n");
+        return 1;
+    }
+    if (sb.version != FS_VERSION) {
+        printf("Unsupported filesystem version %u (expected %u)\n", sb.version, FS_VERSION);
+        return 1;
+    }
+    total_blocks = sb.total_sectors - FS_DATA_LBA;
+    if (total_blocks > FS_BITMAP_SECTS * SECTOR * 8) total_blocks = FS_BITMAP_SECTS * SECTOR * 8;
+
     // Read bitmap
     fseek(img, FS_BITMAP_LBA*SECTOR, SEEK_SET);
-    fread(bitmap, 1, FS_BITMAP_SECTS*SECTOR, img);
+    fread(bitmap, 1, sizeof(bitmap), img);
 
     // Load directory
-    struct DirEntry dir[128];
     fseek(img, FS_ROOT_LBA*SECTOR, SEEK_SET);
     fread(dir, sizeof(dir), 1, img);
 
-    // Find free directory entry
+    // Find free directory entry (refuse duplicates)
     int d = -1;
-    for (int i = 0; i < 128; i++) {
-        if (dir[i].name[0] == 0) { d = i; break; }
+    for (int i = 0; i < FS_MAX_FILES; i++) {
+        if (dir[i].used && strncmp(dir[i].name, name, FS_FILENAME_MAX) == 0) {
+            printf("File '%s' already exists\n", name);
+            return 1;
+        }
+        if (!dir[i].used && d < 0) d = i;
     }
     if (d < 0) { printf("No directory entries left\n"); return 1; }
 
@@ -75,40 +104,47 @@ int main(int argc, char **argv)
     fseek(in, 0, SEEK_SET);
 
     uint32_t blocks = (size + 511) / 512;
-    uint32_t start;
-
-    if (!find_free_blocks(blocks, &start)) {
+    fs_extent_t ext[FS_MAX_EXTENTS];
+    int n = alloc_extents(blocks, ext);
+    if (n < 0) {
         printf("Not enough space.\n");
         return 1;
     }
 
-    // Mark blocks in bitmap
-    for (uint32_t i = 0; i < blocks; i++)
-        set_bitmap(start + i);
-
-    // Write bitmap back
-    fseek(img, FS_BITMAP_LBA*512, SEEK_SET);
-    fwrite(bitmap, 1, FS_BITMAP_SECTS*SECTOR, img);
-
-    // Write data blocks
+    // Mark blocks in bitmap and write data blocks, one extent at a time
     uint8_t buf[512];
-    for (uint32_t i = 0; i < blocks; i++) {
-        memset(buf, 0, 512);
-        fread(buf, 1, 512, in);
-
-        fseek(img, (start + i) * 512, SEEK_SET);
-        fwrite(buf, 1, 512, img);
+    for (int e = 0; e < n; e++) {
+        for (uint32_t i = 0; i < ext[e].count; i++) {
+            set_bitmap(ext[e].start + i);
+            memset(buf, 0, 512);
+            fread(buf, 1, 512, in);
+            write_at(img, ext[e].start + i, buf, 512);
+        }
     }
 
-    // Write directory entry
-    strncpy(dir[d].name, argv[2], 15);
+    // Directory entry; extents past the inline ones go to an indirect block
+    memset(&dir[d], 0, sizeof(dir[d]));
+    strncpy(dir[d].name, name, FS_FILENAME_MAX - 1);
     dir[d].size = size;
-    dir[d].start = start;
-    dir[d].blocks = blocks;
+    dir[d].used = 1;
+    dir[d].nextents = (uint8_t)n;
+    for (int e = 0; e < n && e < FS_INLINE_EXTENTS; e++) dir[d].ext[e] = ext[e];
+    if (n > FS_INLINE_EXTENTS) {
+        fs_extent_t ind;
+        if (alloc_extents(1, &ind) != 1) { printf("Not enough space.\n"); return 1; }
+        set_bitmap(ind.start);
+        memset(buf, 0, 512);
+        memcpy(buf, &ext[FS_INLINE_EXTENTS], (n - FS_INLINE_EXTENTS) * sizeof(fs_extent_t));
+        write_at(img, ind.start, buf, 512);
+        dir[d].indirect = ind.start;
+    }
 
-    fseek(img, FS_ROOT_LBA*512, SEEK_SET);
-    fwrite(dir, sizeof(dir), 1, img);
+    // Write bitmap and directory back
+    write_at(img, FS_BITMAP_LBA, bitmap, sizeof(bitmap));
+    write_at(img, FS_ROOT_LBA, dir, sizeof(dir));
 
-    printf("Added file '%s' (%u bytes) at LBA %u\n", argv[2], size, start);
+    printf("Added file '%s' (%u bytes) in %d extent(s) starting at LBA %u\n",
+           name, size, n, n ? ext[0].start : 0);
+    fclose(img);
     return 0;
 }
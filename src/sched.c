@@ -0,0 +1,315 @@
+/* sched.c - kernel threads and the round-robin scheduler.
+   Threads live in a fixed table; ready ones are linked into a FIFO run
+   queue. schedule() always runs with interrupts off. When nothing is
+   ready (the current thread went to sleep or exited) it halts on the
+   sleeping thread's stack until a tick wakes someone, which is why a
+   thread that is not RUNNING is never preempted. Exited and killed
+   threads are freed by the next switch, never while their stack is in
+   use.
+*/
+
+#include "sched.h"
+#include "timer.h"
+#include "kmalloc.h"
+#include "kstring.h"
+#include "gdt.h"
+
+typedef struct thread {
+    int tid;
+    thread_state_t state;
+    char name[SCHED_NAME_MAX];
+    uint32_t esp;            /* saved by switch_context */
+    uint32_t esp0;           /* kernel stack for traps from ring 3, 0 if none */
+    uint8_t *stack;          /* NULL for thread 0, which runs on the boot stack */
+    vmm_space_t *space;
+    void (*fn)(void *arg);
+    void *arg;
+    uint32_t preempt;        /* preemption allowed only at zero */
+    uint32_t wake;           /* tick at which a sleeping thread is ready again */
+    uint32_t cpu_ms;
+    int fpu_valid;
+    uint8_t fpu[512] __attribute__((aligned(16))); /* fxsave image, or fnsave without SSE */
+    struct thread *next;     /* run queue link */
+} thread_t;
+
+extern void switch_context(uint32_t *save_esp, uint32_t next_esp);
+
+static thread_t threads[SCHED_MAX_THREADS];
+static thread_t *current;
+static thread_t *rq_head, *rq_tail;
+static int next_tid;
+static volatile int need_resched;
+static uint32_t slice_left;
+static int running;
+static int use_fxsave;       /* CR4.OSFXSR is on: XMM state is per thread too */
+static uint8_t fpu_clean[512] __attribute__((aligned(16))); /* fresh state for new threads */
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    asm volatile ("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) asm volatile ("sti" ::: "memory");
+    else asm volatile ("cli" ::: "memory");
+}
+
+static void rq_push(thread_t *t) {
+    t->next = 0;
+    if (rq_tail) rq_tail->next = t;
+    else rq_head = t;
+    rq_tail = t;
+}
+
+static thread_t *rq_pop(void) {
+    thread_t *t = rq_head;
+    if (t) {
+        rq_head = t->next;
+        if (!rq_head) rq_tail = 0;
+        t->next = 0;
+    }
+    return t;
+}
+
+static void rq_remove(thread_t *t) {
+    thread_t *prev = 0;
+    for (thread_t *p = rq_head; p; prev = p, p = p->next) {
+        if (p != t) continue;
+        if (prev) prev->next = p->next;
+        else rq_head = p->next;
+        if (rq_tail == p) rq_tail = prev;
+        p->next = 0;
+        return;
+    }
+}
+
+/* free every zombie except 'keep', whose stack may still be in use */
+static void reap(thread_t *keep) {
+    for (int i = 0; i < SCHED_MAX_THREADS; i++) {
+        thread_t *t = &threads[i];
+        if (t->state != THREAD_ZOMBIE || t == keep) continue;
+        if (t->space) vmm_destroy(t->space);
+        kfree(t->stack);
+        t->space = 0;
+        t->stack = 0;
+        t->state = THREAD_UNUSED;
+    }
+}
+
+/* switch to the next ready thread; interrupts must be off */
+static void schedule(void) {
+    thread_t *prev = current;
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_READY;
+        rq_push(prev);
+    }
+    thread_t *next;
+    while (!(next = rq_pop())) asm volatile ("sti; hlt; cli" ::: "memory");
+    next->state = THREAD_RUNNING;
+    need_resched = 0;
+    slice_left = SCHED_SLICE_MS;
+    reap(prev);
+    if (next == prev) return;
+
+    prev->space = vmm_current();
+    if (use_fxsave) asm volatile ("fxsave %0" : "=m"(prev->fpu));
+    else asm volatile ("fnsave %0" : "=m"(prev->fpu));
+    prev->fpu_valid = 1;
+    current = next;
+    vmm_switch(next->space);
+    if (next->esp0) gdt_set_kernel_stack(next->esp0);
+    if (use_fxsave) asm volatile ("fxrstor %0" :: "m"(*(next->fpu_valid ? next->fpu : fpu_clean)));
+    else if (next->fpu_valid) asm volatile ("frstor %0" :: "m"(next->fpu));
+    else asm volatile ("fninit");
+    switch_context(&prev->esp, next->esp);
+}
+
+/* first code a new thread runs, entered from switch_context's ret */
+static void thread_start(void) {
+    thread_t *t = current;
+    asm volatile ("sti");
+    t->fn(t->arg);
+    thread_exit();
+}
+
+void sched_init(void) {
+    thread_t *t = &threads[0];
+    kmemset(threads, 0, sizeof(threads));
+    t->tid = 0;
+    t->state = THREAD_RUNNING;
+    kstrncpy(t->name, "shell", SCHED_NAME_MAX);
+    t->preempt = 1;
+    current = t;
+    next_tid = 1;
+    slice_left = SCHED_SLICE_MS;
+    /* kmem_init turned on OSFXSR if the CPU has SSE2; the clean image is
+       what fninit plus a default MXCSR give, with every XMM register zero */
+    use_fxsave = kmem_has_sse2();
+    kmemset(fpu_clean, 0, sizeof(fpu_clean));
+    *(uint16_t*)&fpu_clean[0] = 0x037F;   /* FCW */
+    *(uint32_t*)&fpu_clean[24] = 0x1F80;  /* MXCSR */
+    running = 1;
+}
+
+int sched_running(void) {
+    return running;
+}
+
+int thread_create(const char *name, void (*fn)(void *arg), void *arg, vmm_space_t *space) {
+    if (!running || !fn) return -1;
+    uint8_t *stack = (uint8_t*)kmalloc(SCHED_STACK_SIZE);
+    if (!stack) return -1;
+
+    uint32_t flags = irq_save();
+    thread_t *t = 0;
+    for (int i = 1; i < SCHED_MAX_THREADS && !t; i++)
+        if (threads[i].state == THREAD_UNUSED) t = &threads[i];
+    if (!t) {
+        irq_restore(flags);
+        kfree(stack);
+        return -1;
+    }
+    kmemset(t, 0, sizeof(*t));
+    t->tid = next_tid++;
+    kstrncpy(t->name, name ? name : "thread", SCHED_NAME_MAX);
+    t->name[SCHED_NAME_MAX - 1] = 0;
+    t->stack = stack;
+    t->space = space;
+    t->fn = fn;
+    t->arg = arg;
+
+    /* the frame switch_context pops, returning into thread_start; the
+       zero below it stands in for thread_start's own return address */
+    uint32_t *sp = (uint32_t*)(stack + SCHED_STACK_SIZE);
+    *--sp = 0;
+    *--sp = (uint32_t)(uintptr_t)thread_start;
+    *--sp = 0;     /* ebp */
+    *--sp = 0;     /* ebx */
+    *--sp = 0;     /* esi */
+    *--sp = 0;     /* edi */
+    *--sp = 0x002; /* eflags: IF stays off until thread_start */
+    t->esp = (uint32_t)(uintptr_t)sp;
+
+    t->state = THREAD_READY;
+    rq_push(t);
+    irq_restore(flags);
+    return t->tid;
+}
+
+void thread_exit(void) {
+    asm volatile ("cli");
+    current->state = THREAD_ZOMBIE;
+    schedule();
+    for (;;) asm volatile ("hlt"); /* not reached */
+}
+
+int thread_kill(int tid) {
+    if (!running || tid <= 0 || tid == current->tid) return -1;
+    uint32_t flags = irq_save();
+    int rc = -1;
+    for (int i = 1; i < SCHED_MAX_THREADS; i++) {
+        thread_t *t = &threads[i];
+        if (t->tid != tid || t->state == THREAD_UNUSED || t->state == THREAD_ZOMBIE) continue;
+        if (t->state == THREAD_READY) rq_remove(t);
+        t->state = THREAD_ZOMBIE;
+        reap(current);
+        rc = 0;
+        break;
+    }
+    irq_restore(flags);
+    return rc;
+}
+
+int thread_current(void) {
+    return current ? current->tid : 0;
+}
+
+void sched_yield(void) {
+    if (!running) return;
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+void sched_sleep_ms(uint32_t ms) {
+    if (!running) return;
+    uint32_t flags = irq_save();
+    current->wake = timer_ticks() + ms;
+    current->state = THREAD_SLEEPING;
+    schedule();
+    irq_restore(flags);
+}
+
+void sched_idle(void) {
+    uint32_t flags = irq_save();
+    if (running && rq_head) schedule();
+    else asm volatile ("sti; hlt" ::: "memory");
+    irq_restore(flags);
+}
+
+void sched_set_kernel_stack(uint32_t esp0) {
+    if (current) current->esp0 = esp0;
+    if (esp0) gdt_set_kernel_stack(esp0);
+}
+
+uint32_t sched_kernel_stack(void) {
+    return current ? current->esp0 : 0;
+}
+
+void preempt_disable(void) {
+    if (current) current->preempt++;
+}
+
+void preempt_enable(void) {
+    if (current && current->preempt) current->preempt--;
+}
+
+uint32_t preempt_save(void) {
+    if (!current) return 0;
+    uint32_t count = current->preempt;
+    current->preempt = 0;
+    return count;
+}
+
+void preempt_restore(uint32_t count) {
+    if (current) current->preempt = count;
+}
+
+int sched_get_info(int slot, thread_info_t *out) {
+    if (slot < 0 || slot >= SCHED_MAX_THREADS) return -1;
+    const thread_t *t = &threads[slot];
+    if (!running || t->state == THREAD_UNUSED) return 1;
+    vmm_space_t *vs = t == current ? vmm_current() : t->space;
+    out->tid = t->tid;
+    out->state = t->state;
+    kmemcpy(out->name, t->name, SCHED_NAME_MAX);
+    out->cpu_ms = t->cpu_ms;
+    out->pages = vs ? vs->resident : 0;
+    return 0;
+}
+
+void sched_tick(uint32_t now) {
+    if (!running) return;
+    if (current->state == THREAD_RUNNING) current->cpu_ms++; /* not while idle */
+    for (int i = 0; i < SCHED_MAX_THREADS; i++) {
+        thread_t *t = &threads[i];
+        if (t->state == THREAD_SLEEPING && (int32_t)(now - t->wake) >= 0) {
+            t->state = THREAD_READY;
+            rq_push(t);
+        }
+    }
+    if (slice_left && --slice_left == 0) need_resched = 1;
+}
+
+void sched_irq_exit(void) {
+    if (!running || !need_resched) return;
+    if (current->state != THREAD_RUNNING || current->preempt) return;
+    if (!rq_head) {
+        /* nobody else wants the CPU: start a fresh slice */
+        need_resched = 0;
+        slice_left = SCHED_SLICE_MS;
+        return;
+    }
+    schedule();
+}
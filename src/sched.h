@@ -0,0 +1,74 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "vmm.h"
+
+/* Kernel threads with a round-robin run queue. IRQ0 charges the running
+   thread one tick and, once its SCHED_SLICE_MS slice is used up, the
+   thread is preempted on the way out of the interrupt (after the EOI).
+   A thread is only preempted while its preempt count is zero: the shell
+   (thread 0, the boot context) keeps a count of one, so kernel code runs
+   to completion and gives up the CPU only where it waits (ksleep_ms, the
+   keyboard), while program code is always preemptible. Syscalls and
+   faults run with interrupts off, so they are never preempted either.
+   Each thread carries its address space and x87/SSE state across
+   switches. */
+
+#define SCHED_MAX_THREADS 16
+#define SCHED_STACK_SIZE  16384
+#define SCHED_SLICE_MS    10
+#define SCHED_NAME_MAX    16
+
+typedef enum {
+    THREAD_UNUSED,
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_SLEEPING,
+    THREAD_ZOMBIE, /* exited or killed; freed by the next switch */
+} thread_state_t;
+
+typedef struct {
+    int tid;
+    thread_state_t state;
+    char name[SCHED_NAME_MAX];
+    uint32_t cpu_ms;   /* ticks charged while running */
+    uint32_t pages;    /* resident pages of its address space */
+} thread_info_t;
+
+/* adopt the running boot context as thread 0 ("shell") */
+void sched_init(void);
+int sched_running(void);
+
+/* start fn(arg) in a new thread that owns 'space' (may be NULL) and
+   destroys it on exit; returns the tid or -1 */
+int thread_create(const char *name, void (*fn)(void *arg), void *arg, vmm_space_t *space);
+void thread_exit(void) __attribute__((noreturn));
+int thread_kill(int tid);
+int thread_current(void);
+
+void sched_yield(void);
+void sched_sleep_ms(uint32_t ms);
+/* nothing to do until the next interrupt: run another thread if one is
+   ready, otherwise halt */
+void sched_idle(void);
+
+/* kernel stack top for traps from ring 3 while the current thread runs
+   (set by user_enter); 0 while the thread is not in a program */
+void sched_set_kernel_stack(uint32_t esp0);
+uint32_t sched_kernel_stack(void);
+
+void preempt_disable(void);
+void preempt_enable(void);
+/* make the current thread preemptible; returns the count to restore */
+uint32_t preempt_save(void);
+void preempt_restore(uint32_t count);
+
+/* fill 'out' for table slot 'slot'; -1 past the end, 1 for an empty slot */
+int sched_get_info(int slot, thread_info_t *out);
+
+/* from the timer IRQ and from irq_dispatch after the EOI */
+void sched_tick(uint32_t now);
+void sched_irq_exit(void);
+
+#endif
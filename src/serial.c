@@ -0,0 +1,186 @@
+/* serial.c - 16550 UART output.
+   Writers copy into tx_ring with interrupts off and arm the THRE
+   interrupt. The IRQ4 handler refills the FIFO 16 bytes at a time and
+   disarms itself once the ring is empty, so printing never waits on the
+   line rate unless the ring is full. Writers that run with interrupts
+   off (syscalls entered through int 0x80) only queue; IRQ4 picks the
+   bytes up once the return to the caller turns interrupts back on.
+   Paths that halt for good call serial_flush first.
+*/
+
+#include "serial.h"
+#include "irq.h"
+#include "port.h"
+#include "kformat.h"
+#include "kstring.h"
+
+#define UART_DATA 0
+#define UART_IER  1
+#define UART_IIR  2 /* read */
+#define UART_FCR  2 /* write */
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+#define UART_MSR  6
+#define UART_SCR  7
+
+#define IER_THRE  0x02
+#define LSR_THRE  0x20
+#define UART_FIFO_DEPTH 16
+
+static char tx_ring[SERIAL_TX_RING];
+static volatile uint32_t tx_head; /* next free slot, advanced by writers */
+static volatile uint32_t tx_tail; /* next byte to send, advanced by the drain */
+static int com1_ready; /* COM1 present, initialised and on IRQ4 */
+static int mirror;
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+static inline void irq_restore(uint32_t flags) {
+    if (flags & 0x200) __asm__ volatile ("sti" ::: "memory");
+}
+
+/* move up to one FIFO's worth from the ring into the UART; the caller
+   has interrupts off and knows the FIFO is empty */
+static void tx_fill(void) {
+    for (int i = 0; i < UART_FIFO_DEPTH && tx_tail != tx_head; i++) {
+        outb(SERIAL_COM1 + UART_DATA, (uint8_t)tx_ring[tx_tail & (SERIAL_TX_RING - 1)]);
+        tx_tail++;
+    }
+}
+
+/* poll the whole ring out; interrupts are off */
+static void tx_drain(void) {
+    while (tx_tail != tx_head) {
+        while (!(inb(SERIAL_COM1 + UART_LSR) & LSR_THRE));
+        tx_fill();
+    }
+}
+
+static void serial_irq(void) {
+    uint8_t iir;
+    while (!((iir = inb(SERIAL_COM1 + UART_IIR)) & 1)) {
+        switch ((iir >> 1) & 7) {
+            case 1: /* transmitter holding register empty */
+                tx_fill();
+                if (tx_tail == tx_head) outb(SERIAL_COM1 + UART_IER, 0);
+                break;
+            case 2: case 6: /* received data / timeout: nothing reads COM1 yet */
+                (void)inb(SERIAL_COM1 + UART_DATA);
+                break;
+            case 3:
+                (void)inb(SERIAL_COM1 + UART_LSR);
+                break;
+            default:
+                (void)inb(SERIAL_COM1 + UART_MSR);
+                break;
+        }
+    }
+}
+
+void serial_init(uint16_t port) {
+    outb(port + UART_IER, 0x00); // Disable interrupts
+    outb(port + UART_LCR, 0x80); // Enable DLAB
+    outb(port + UART_DATA, 0x03); // 38400 baud
+    outb(port + UART_IER, 0x00);
+    outb(port + UART_LCR, 0x03); // 8 bits, no parity, one stop bit
+    outb(port + UART_FCR, 0xC7); // Enable and clear FIFOs, 14-byte RX threshold
+    outb(port + UART_MCR, 0x0B); // OUT2 (IRQ line), RTS, DTR
+    if (port != SERIAL_COM1) return;
+    /* no UART behind the port if the scratch register does not hold a value */
+    outb(port + UART_SCR, 0xAE);
+    if (inb(port + UART_SCR) != 0xAE) return;
+    tx_head = tx_tail = 0;
+    irq_install(IRQ_COM1, serial_irq);
+    com1_ready = 1;
+}
+
+static void serial_putc_polled(uint16_t port, char c) {
+    while (!(inb(port + UART_LSR) & LSR_THRE));
+    outb(port + UART_DATA, c);
+}
+
+void serial_write(uint16_t port, const char *s, int len) {
+    if (port != SERIAL_COM1 || !com1_ready) {
+        while (len-- > 0) serial_putc_polled(port, *s++);
+        return;
+    }
+    uint32_t flags = irq_save();
+    while (len > 0) {
+        if (tx_head - tx_tail == SERIAL_TX_RING) {
+            /* ring full: make room by feeding the FIFO ourselves */
+            while (!(inb(SERIAL_COM1 + UART_LSR) & LSR_THRE));
+            tx_fill();
+        }
+        uint32_t room = SERIAL_TX_RING - (tx_head - tx_tail);
+        uint32_t at = tx_head & (SERIAL_TX_RING - 1);
+        uint32_t n = (uint32_t)len;
+        if (n > room) n = room;
+        if (n > SERIAL_TX_RING - at) n = SERIAL_TX_RING - at;
+        kmemcpy(&tx_ring[at], s, n);
+        tx_head += n;
+        s += n;
+        len -= (int)n;
+    }
+    /* the UART raises THRE as soon as this is set if its FIFO is idle */
+    outb(SERIAL_COM1 + UART_IER, IER_THRE);
+    irq_restore(flags);
+}
+
+void serial_putc(uint16_t port, char c) {
+    serial_write(port, &c, 1);
+}
+
+void serial_puts(uint16_t port, const char* s) {
+    serial_write(port, s, (int)kstrlen(s));
+}
+
+/* formatter sink for a serial port */
+typedef struct {
+    kfmt_sink_t sink;
+    uint16_t port;
+} serial_sink_t;
+
+static void serial_sink_write(kfmt_sink_t *sink, const char *s, int len) {
+    serial_write(((serial_sink_t*)sink)->port, s, len);
+}
+
+void serial_printf(uint16_t port, const char* fmt, ...) {
+    serial_sink_t out = { { serial_sink_write }, port };
+    va_list args;
+    va_start(args, fmt);
+    kvformat(&out.sink, fmt, args);
+    va_end(args);
+}
+
+void serial_flush(void) {
+    if (!com1_ready) return;
+    uint32_t flags = irq_save();
+    tx_drain();
+    outb(SERIAL_COM1 + UART_IER, 0);
+    irq_restore(flags);
+}
+
+void serial_set_mirror(int on) {
+    mirror = on && com1_ready;
+}
+
+int serial_mirror_enabled(void) {
+    return mirror;
+}
+
+void serial_mirror_write(const char *s, int len) {
+    if (!mirror) return;
+    while (len > 0) {
+        int n = 0;
+        while (n < len && s[n] != '\n') n++;
+        if (n) serial_write(SERIAL_COM1, s, n);
+        if (n == len) break;
+        serial_write(SERIAL_COM1, "\r\n", 2);
+        s += n + 1;
+        len -= n + 1;
+    }
+}
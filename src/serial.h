@@ -0,0 +1,29 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+
+/* 16550 UART driver. COM1 transmits from a ring buffer that the THRE
+   interrupt (IRQ4) drains into the 16-byte FIFO. Other ports poll the
+   LSR. COM1 writers with interrupts disabled still only queue, so code
+   about to halt with interrupts off must call serial_flush. */
+
+#define SERIAL_COM1 0x3F8
+#define SERIAL_TX_RING 4096 /* power of two */
+
+void serial_init(uint16_t port);
+void serial_putc(uint16_t port, char c);
+void serial_puts(uint16_t port, const char* s);
+void serial_write(uint16_t port, const char *s, int len);
+void serial_printf(uint16_t port, const char* fmt, ...);
+
+/* spin until everything queued for COM1 has left the FIFO */
+void serial_flush(void);
+
+/* console mirror: when enabled, text written to the VGA console is also
+   sent to COM1 with "\n" expanded to "\r\n" */
+void serial_set_mirror(int on);
+int serial_mirror_enabled(void);
+void serial_mirror_write(const char *s, int len);
+
+#endif
@@ -0,0 +1,144 @@
+/* slab.c - object caches on top of the page-frame allocator.
+   A slab is one 4 KB page laid out as
+
+     [ slab_t header | uint16 free-index stack | objects ... ]
+
+   Free objects are tracked by index on a small stack inside the header
+   area rather than by a pointer stored in the object, so constructed
+   state survives free/alloc cycles. Each cache keeps a singly linked list
+   of its slabs; the slab that satisfied the last allocation is moved to
+   the front so the common case is O(1). An empty slab is returned to the
+   PMM unless it is the cache's only one.
+*/
+
+#include "slab.h"
+#include "pmm.h"
+#include <stdint.h>
+
+#define SLAB_MAGIC 0x51AB51ABu
+
+typedef struct slab {
+    uint32_t magic;
+    kmem_cache_t *cache;
+    struct slab *next;
+    uint16_t nfree;    /* entries on the free-index stack */
+    uint16_t objs_off; /* offset of object 0 from the page start */
+} slab_t;
+
+struct kmem_cache {
+    char name[KMEM_NAME_MAX];
+    uint32_t obj_size;
+    uint16_t per_slab;
+    uint16_t objs_off;
+    void (*ctor)(void *obj);
+    slab_t *slabs;
+    kmem_cache_stats_t stats;
+};
+
+static kmem_cache_t caches[KMEM_MAX_CACHES];
+static int cache_count;
+
+static uint16_t *free_stack(slab_t *s) {
+    return (uint16_t*)(s + 1);
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, void (*ctor)(void *obj)) {
+    if (size == 0 || cache_count >= KMEM_MAX_CACHES) return 0;
+    uint32_t obj = (size + 7) & ~7u;
+    /* fit as many objects as possible after the header and the index stack,
+       keeping object 0 16-byte aligned */
+    uint32_t n = (PMM_FRAME_SIZE - sizeof(slab_t)) / (obj + sizeof(uint16_t));
+    uint32_t off = 0;
+    while (n > 0) {
+        off = (sizeof(slab_t) + n * sizeof(uint16_t) + 15) & ~15u;
+        if (off + n * obj <= PMM_FRAME_SIZE) break;
+        n--;
+    }
+    if (n == 0) return 0;
+
+    kmem_cache_t *c = &caches[cache_count++];
+    int i = 0;
+    for (; name && name[i] && i < KMEM_NAME_MAX - 1; i++) c->name[i] = name[i];
+    c->name[i] = 0;
+    c->obj_size = obj;
+    c->per_slab = (uint16_t)n;
+    c->objs_off = (uint16_t)off;
+    c->ctor = ctor;
+    c->slabs = 0;
+    for (i = 0; i < KMEM_NAME_MAX; i++) c->stats.name[i] = c->name[i];
+    c->stats.obj_size = obj;
+    return c;
+}
+
+static slab_t *slab_grow(kmem_cache_t *c) {
+    uint32_t page = pmm_alloc_frame();
+    if (!page) return 0;
+    slab_t *s = (slab_t*)(uintptr_t)page;
+    s->magic = SLAB_MAGIC;
+    s->cache = c;
+    s->objs_off = c->objs_off;
+    s->nfree = c->per_slab;
+    uint16_t *stack = free_stack(s);
+    for (uint32_t i = 0; i < c->per_slab; i++) {
+        stack[i] = (uint16_t)(c->per_slab - 1 - i); /* hand out low addresses first */
+        if (c->ctor) c->ctor((uint8_t*)s + s->objs_off + i * c->obj_size);
+    }
+    s->next = c->slabs;
+    c->slabs = s;
+    c->stats.slabs++;
+    c->stats.capacity += c->per_slab;
+    return s;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *c) {
+    if (!c) return 0;
+    slab_t **link = &c->slabs;
+    while (*link && (*link)->nfree == 0) link = &(*link)->next;
+    slab_t *s = *link;
+    if (s) {
+        /* move to the front for the next allocation */
+        *link = s->next;
+        s->next = c->slabs;
+        c->slabs = s;
+    } else {
+        s = slab_grow(c);
+        if (!s) return 0;
+    }
+    uint16_t idx = free_stack(s)[--s->nfree];
+    c->stats.active++;
+    c->stats.allocs++;
+    return (uint8_t*)s + s->objs_off + idx * c->obj_size;
+}
+
+kmem_cache_t *kmem_cache_of(const void *obj) {
+    if (!obj) return 0;
+    const slab_t *s = (const slab_t*)((uintptr_t)obj & ~(uintptr_t)(PMM_FRAME_SIZE - 1));
+    return s->magic == SLAB_MAGIC ? s->cache : 0;
+}
+
+void kmem_cache_free(kmem_cache_t *c, void *obj) {
+    if (!c || !obj) return;
+    slab_t *s = (slab_t*)((uintptr_t)obj & ~(uintptr_t)(PMM_FRAME_SIZE - 1));
+    if (s->magic != SLAB_MAGIC || s->cache != c) return;
+    uint32_t off = (uint32_t)((uint8_t*)obj - (uint8_t*)s) - s->objs_off;
+    free_stack(s)[s->nfree++] = (uint16_t)(off / c->obj_size);
+    c->stats.active--;
+    c->stats.frees++;
+    if (s->nfree < c->per_slab) return;
+
+    /* give an empty slab back unless it is the cache's only one */
+    if (c->slabs == s && !s->next) return;
+    slab_t **link = &c->slabs;
+    while (*link != s) link = &(*link)->next;
+    *link = s->next;
+    s->magic = 0;
+    c->stats.slabs--;
+    c->stats.capacity -= c->per_slab;
+    pmm_free_frame((uint32_t)(uintptr_t)s);
+}
+
+int kmem_cache_stats(int index, kmem_cache_stats_t *out) {
+    if (index < 0 || index >= cache_count || !out) return -1;
+    *out = caches[index].stats;
+    return 0;
+}
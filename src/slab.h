@@ -0,0 +1,37 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Object caches: each cache hands out fixed-size objects carved from
+   4 KB pages taken from the PMM. An optional constructor runs once per
+   object when its slab is created, and objects are expected to be
+   returned to the cache in that constructed state. */
+
+#define KMEM_MAX_CACHES 24
+#define KMEM_NAME_MAX   16
+
+typedef struct kmem_cache kmem_cache_t;
+
+typedef struct {
+    char name[KMEM_NAME_MAX];
+    uint32_t obj_size;  /* bytes per object, including padding */
+    uint32_t active;    /* objects currently allocated */
+    uint32_t capacity;  /* objects the cache's slabs can hold */
+    uint32_t slabs;     /* pages owned by the cache */
+    uint32_t allocs;
+    uint32_t frees;
+} kmem_cache_stats_t;
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, void (*ctor)(void *obj));
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+/* cache owning 'obj' (found through its page header), or 0 */
+kmem_cache_t *kmem_cache_of(const void *obj);
+
+/* stats of the index-th cache; -1 once past the last one */
+int kmem_cache_stats(int index, kmem_cache_stats_t *out);
+
+#endif
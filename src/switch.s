@@ -0,0 +1,25 @@
+/* switch.s - kernel thread context switch.
+ * switch_context(uint32_t *save_esp, uint32_t next_esp) pushes the
+ * callee-saved registers and EFLAGS on the current stack, stores the
+ * stack pointer in *save_esp, then loads next_esp and pops the same
+ * frame; the ret resumes the next thread where it called switch_context
+ * (or at its start routine, see thread_create in sched.c).
+ */
+    .section .text
+    .globl switch_context
+switch_context:
+    movl 4(%esp), %eax
+    movl 8(%esp), %edx
+    pushl %ebp
+    pushl %ebx
+    pushl %esi
+    pushl %edi
+    pushfl
+    movl %esp, (%eax)
+    movl %edx, %esp
+    popfl
+    popl %edi
+    popl %esi
+    popl %ebx
+    popl %ebp
+    ret
@@ -0,0 +1,234 @@
+/* syscall.c - the system call table shared by int 0x80 and SYSENTER.
+   Handlers take EBX, ECX, EDX and return the value for EAX. Every
+   pointer a handler dereferences goes through user_buf or user_str
+   first; the pages behind it may still be absent and are faulted in by
+   the copy itself.
+*/
+
+#include "syscall.h"
+#include "io.h"
+#include "vga_mode13.h"
+#include "timer.h"
+#include "trace.h"
+#include "elf.h"
+#include "vmm.h"
+#include "framebuffer.h"
+#include "sched.h"
+
+#define SYSCALL_STR_MAX 4096
+
+typedef uint32_t (*syscall_fn_t)(uint32_t ebx, uint32_t ecx, uint32_t edx);
+
+/* an empty buffer is never touched, so any address will do */
+static int user_buf(uint32_t addr, uint32_t len, int write) {
+    return len == 0 || vmm_check_user(addr, len, write) == 0;
+}
+
+/* length of the NUL-terminated user string at addr, or -1 */
+static int user_str(uint32_t addr) {
+    for (uint32_t n = 0; n < SYSCALL_STR_MAX; n++) {
+        if (!user_buf(addr + n, 1, 0)) return -1;
+        if (((const char*)addr)[n] == 0) return (int)n;
+    }
+    return -1;
+}
+
+/* print NUL-terminated string at EBX */
+static uint32_t sys_print(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    if (user_str(ebx) < 0) return (uint32_t)-1;
+    printf_k("%s", (const char*)ebx);
+    return 0;
+}
+
+/* write ECX bytes from EBX (not fd-aware); returns bytes written */
+static uint32_t sys_write(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)edx;
+    const char *buf = (const char*)ebx;
+    if (!user_buf(ebx, ecx, 0)) return (uint32_t)-1;
+    for (uint32_t i = 0; i < ecx; i++) putc_k(buf[i]);
+    return ecx;
+}
+
+/* read a line into EBX, up to ECX-1 bytes; returns its length, or -1
+   when the caller is a background (spawned) thread, which does not own
+   the keyboard */
+static uint32_t sys_readline(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)edx;
+    char *buf = (char*)ebx;
+    if ((int)ecx <= 0) return 0;
+    if (!user_buf(ebx, ecx, 1)) return (uint32_t)-1;
+    return (uint32_t)readline(buf, (int)ecx);
+}
+
+/* EBX = fg (0-15), ECX = bg (0-15) */
+static uint32_t sys_setcolor(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)edx;
+    if (ebx <= 15 && ecx <= 15) vga_set_color((uint8_t)ebx, (uint8_t)ecx);
+    return 0;
+}
+
+/* EBX = x, ECX = y */
+static uint32_t sys_setcursor(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)edx;
+    vga_set_cursor((int)ebx, (int)ecx);
+    return 0;
+}
+
+/* EBX = pointer to two ints [x, y] */
+static uint32_t sys_getcursor(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    int *out = (int*)ebx;
+    if (!user_buf(ebx, 2 * sizeof(int), 1)) return (uint32_t)-1;
+    vga_get_cursor(&out[0], &out[1]);
+    return 0;
+}
+
+static uint32_t sys_clear(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    clrscr();
+    return 0;
+}
+
+static uint32_t sys_mode13(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    vga_set_mode13();
+    return 0;
+}
+
+/* EBX = x, ECX = y, EDX = color; shows at once, as it always has */
+static uint32_t sys_putpixel(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    vga_putpixel((int)ebx, (int)ecx, (uint8_t)edx);
+    vga_show_now((int)ebx, (int)ecx, 1, 1);
+    return 0;
+}
+
+static uint32_t sys_palette_default(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    vga_set_palette_default();
+    return 0;
+}
+
+/* EBX = color; shows at once, as it always has */
+static uint32_t sys_clear13(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    vga_clear_mode13((uint8_t)ebx);
+    vga_show_now(0, 0, VGA13_W, VGA13_H);
+    return 0;
+}
+
+static uint32_t sys_textmode(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    vga_set_text_mode();
+    return 0;
+}
+
+/* EBX = milliseconds */
+static uint32_t sys_sleep(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    ksleep_ms(ebx);
+    return 0;
+}
+
+/* milliseconds since boot */
+static uint32_t sys_ticks(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    return timer_ticks();
+}
+
+/* end the program with status EBX; returns only if called from ring 0 */
+static uint32_t sys_exit(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    elf_exit((int)ebx);
+    return (uint32_t)-1;
+}
+
+/* EBX = pixels, ECX = SYSCALL_XY(x, y), EDX = SYSCALL_WH(w, h) */
+static uint32_t sys_blit13(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    uint32_t w = edx & 0xFFFF, h = edx >> 16;
+    if (!user_buf(ebx, w * h, 0)) return (uint32_t)-1;
+    return (uint32_t)vga_blit13((int)(ecx & 0xFFFF), (int)(ecx >> 16), (int)w, (int)h,
+                                (const uint8_t*)ebx, (int)w);
+}
+
+/* EBX = R,G,B byte triples, ECX = first index, EDX = count */
+static uint32_t sys_setpalette(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    if (ecx > 255 || edx == 0 || edx > 256 - ecx) return (uint32_t)-1;
+    if (!user_buf(ebx, edx * 3, 0)) return (uint32_t)-1;
+    vga_set_palette((int)ecx, (int)edx, (const uint8_t*)ebx);
+    return 0;
+}
+
+/* EBX = 0xRRGGBB pixels, ECX = SYSCALL_XY(x, y), EDX = SYSCALL_WH(w, h) */
+static uint32_t sys_fbblit(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    uint32_t w = edx & 0xFFFF, h = edx >> 16;
+    if (w > 4096 || h > 4096 || !user_buf(ebx, w * h * 4, 0)) return (uint32_t)-1;
+    return (uint32_t)fb_blit(ecx & 0xFFFF, ecx >> 16, w, h, (const uint32_t*)ebx, w);
+}
+
+/* EBX = pointer to three uint32s [width, height, bpp]; -1 without a framebuffer */
+static uint32_t sys_fbinfo(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ecx; (void)edx;
+    if (!fb_available() || !user_buf(ebx, 3 * sizeof(uint32_t), 1)) return (uint32_t)-1;
+    uint32_t *out = (uint32_t*)ebx;
+    out[0] = fb_width();
+    out[1] = fb_height();
+    out[2] = fb_bpp();
+    return 0;
+}
+
+/* show the mode 13h back buffer; returns 1 if anything was copied */
+static uint32_t sys_present(uint32_t ebx, uint32_t ecx, uint32_t edx) {
+    (void)ebx; (void)ecx; (void)edx;
+    /* the retrace wait can take a whole frame: let interrupts in so no
+       timer ticks are lost, but stay on this thread until the copy is done */
+    preempt_disable();
+    asm volatile ("sti" ::: "memory");
+    int copied = vga_present();
+    asm volatile ("cli" ::: "memory");
+    preempt_enable();
+    return (uint32_t)copied;
+}
+
+static const syscall_fn_t syscall_table[SYS_COUNT] = {
+    [SYS_PRINT]           = sys_print,
+    [SYS_WRITE]           = sys_write,
+    [SYS_READLINE]        = sys_readline,
+    [SYS_SETCOLOR]        = sys_setcolor,
+    [SYS_SETCURSOR]       = sys_setcursor,
+    [SYS_GETCURSOR]       = sys_getcursor,
+    [SYS_CLEAR]           = sys_clear,
+    [SYS_MODE13]          = sys_mode13,
+    [SYS_PUTPIXEL]        = sys_putpixel,
+    [SYS_PALETTE_DEFAULT] = sys_palette_default,
+    [SYS_CLEAR13]         = sys_clear13,
+    [SYS_TEXTMODE]        = sys_textmode,
+    [SYS_SLEEP]           = sys_sleep,
+    [SYS_TICKS]           = sys_ticks,
+    [SYS_EXIT]            = sys_exit,
+    [SYS_BLIT13]          = sys_blit13,
+    [SYS_SETPALETTE]      = sys_setpalette,
+    [SYS_FBBLIT]          = sys_fbblit,
+    [SYS_FBINFO]          = sys_fbinfo,
+    [SYS_PRESENT]         = sys_present,
+};
+
+void syscall_dispatch(uint32_t *regs) {
+    /* pushad order, lowest address first: EDI ESI EBP ESP EBX EDX ECX EAX */
+    uint32_t num = regs[7];
+    TRACE_SCOPE(TRACE_SYSCALL(num), regs[4]);
+    if (num == SYS_EXIT) TRACE_SCOPE_END(); /* it does not come back here */
+    if (num < SYS_COUNT && syscall_table[num]) {
+        regs[7] = syscall_table[num](regs[4], regs[6], regs[5]);
+        return;
+    }
+    printf_k("Unknown syscall %u\n", num);
+    printf_k("regs: EAX=%#x ECX=%#x EDX=%#x EBX=%#x ESI=%#x EDI=%#x EBP=%#x\n",
+             regs[7], regs[6], regs[5], regs[4], regs[1], regs[0], regs[2]);
+    regs[7] = (uint32_t)-1;
+}
+
+void syscall_bad_frame(void) {
+    printf_k("sysenter: bad user frame\n");
+    elf_exit(-1);
+}
@@ -0,0 +1,59 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+
+/* System calls. Programs enter through int 0x80 or, where the CPU has
+   it, SYSENTER; both land in syscall_dispatch with the same register
+   frame (pushad order, see interrupt.h): EAX holds the number, EBX, ECX
+   and EDX the arguments, and the result goes back in EAX. Pointer
+   arguments must lie inside the calling program's mapped areas, or the
+   call fails with -1 without touching them.
+
+   SYSENTER clobbers ECX and EDX, so a fast call passes them on the user
+   stack instead. The caller pushes its EDX and ECX arguments and the
+   address to resume at, points ECX at that frame and executes SYSENTER:
+       push edx; push ecx; push $resume; mov esp, ecx; sysenter
+   resume: add $12, esp */
+
+#define SYS_PRINT          1
+#define SYS_WRITE          2
+#define SYS_READLINE       3
+#define SYS_SETCOLOR       4
+#define SYS_SETCURSOR      5
+#define SYS_GETCURSOR      6
+#define SYS_CLEAR          7
+#define SYS_MODE13         8
+#define SYS_PUTPIXEL       9
+#define SYS_PALETTE_DEFAULT 10
+#define SYS_CLEAR13        11
+#define SYS_TEXTMODE       12
+#define SYS_SLEEP          13
+#define SYS_TICKS          14
+#define SYS_EXIT           15
+#define SYS_BLIT13         16
+#define SYS_SETPALETTE     17
+#define SYS_FBBLIT         18
+#define SYS_FBINFO         19
+#define SYS_PRESENT        20
+#define SYS_COUNT          21
+
+/* SYS_BLIT13 and SYS_FBBLIT take a source buffer in EBX and pack the
+   destination rectangle two 16-bit halves to a register:
+   ECX = SYSCALL_XY(x, y), EDX = SYSCALL_WH(w, h). Source rows are w
+   pixels long: bytes for mode 13h, 0xRRGGBB words for the framebuffer.
+   Mode 13h calls (SYS_PUTPIXEL, SYS_CLEAR13, SYS_BLIT13) draw into the
+   kernel's back buffer. SYS_PUTPIXEL and SYS_CLEAR13 also write VRAM
+   straight away, so programs written before SYS_PRESENT still show;
+   SYS_BLIT13 output appears when SYS_PRESENT copies it at the next
+   vertical retrace. */
+#define SYSCALL_XY(x, y) (((uint32_t)(y) << 16) | ((uint32_t)(x) & 0xFFFF))
+#define SYSCALL_WH(w, h) (((uint32_t)(h) << 16) | ((uint32_t)(w) & 0xFFFF))
+
+/* called from isr80_stub and sysenter_entry (isr80.s) */
+void syscall_dispatch(uint32_t *regs);
+
+/* sysenter_entry found ECX pointing outside the user region */
+void syscall_bad_frame(void);
+
+#endif
@@ -1,6 +1,6 @@
 /* tetris.c -- freestanding 32-bit flat binary for your OS run() loader
    - Direct VGA text mode at 0xB8000 (80x25)
-   - Polls keyboard ports (0x64/0x60) for basic keys (non-blocking)
+   - Polls the keyboard scancode ring for basic keys (non-blocking)
    - Controls: a(left) d(right) s(down) w(rotate) q(quit)
    - Compile with i386 freestanding toolchain and add to disk image.
 */
@@ -60,8 +60,9 @@ static u32 lfsr32(void){
 
 /* Non-blocking keyboard: return 0 if none, else ASCII char for keys we handle */
 static int kb_poll_key(void){
-    if (!(inb(0x64) & 1)) return 0; /* no data */
-    u8 sc = inb(0x60);
+    int raw = kbd_getscancode(); /* from the IRQ1 ring */
+    if (raw < 0) return 0; /* no data */
+    u8 sc = (u8)raw;
     /* ignore key releases (set top bit) */
     if (sc & 0x80) return 0;
     /* map scancodes (set 1) for letters and space */
@@ -213,10 +214,9 @@ static void draw_all(void){
     for (int i=0;i<ni;i++) vga_putch_at(sr+1, sc+i, numbuf[i], ATTR_NORMAL);
 }
 
-/* tiny sleep-ish busy wait (calibrated on simple loops) */
+/* frame pacing on the PIT: the CPU halts between ticks */
 static void delay_ms(int ms){
-    volatile u32 cnt = (u32)(ms * 20000);
-    while (cnt--) { __asm__ volatile("nop"); }
+    ksleep_ms((uint32_t)ms);
 }
 
 /* main */
@@ -0,0 +1,50 @@
+/* timer.c - 8253/8254 PIT tick source and sleeping.
+   Channel 0 runs in rate-generator mode at TIMER_HZ; the IRQ0 handler
+   bumps a counter and charges the tick to the scheduler. Before the
+   scheduler starts, ksleep_ms halts between ticks instead of spinning;
+   after that it puts the calling thread to sleep.
+*/
+
+#include "timer.h"
+#include "irq.h"
+#include "port.h"
+#include "sched.h"
+#include <stdint.h>
+
+#define PIT_CH0     0x40
+#define PIT_CMD     0x43
+#define PIT_BASE_HZ 1193182
+
+static volatile uint32_t ticks;
+
+static void timer_irq(void) {
+    ticks++;
+    sched_tick(ticks);
+}
+
+void timer_init(void) {
+    uint32_t divisor = (PIT_BASE_HZ + TIMER_HZ / 2) / TIMER_HZ;
+    outb(PIT_CMD, 0x34); /* channel 0, lo/hi byte, mode 2, binary */
+    outb(PIT_CH0, (uint8_t)(divisor & 0xFF));
+    outb(PIT_CH0, (uint8_t)(divisor >> 8));
+    irq_install(IRQ_TIMER, timer_irq);
+}
+
+uint32_t timer_ticks(void) {
+    return ticks;
+}
+
+void ksleep_ms(uint32_t ms) {
+    /* once threads exist, sleeping hands the CPU to the others */
+    if (sched_running()) {
+        sched_sleep_ms(ms);
+        return;
+    }
+    uint32_t start = ticks;
+    uint32_t flags;
+    asm volatile ("pushfl; popl %0" : "=r"(flags));
+    /* may be called from the syscall gate with IF clear: enable interrupts
+       for the wait and put the caller's IF back afterwards */
+    while (ticks - start < ms) asm volatile ("sti; hlt" ::: "memory");
+    if (!(flags & 0x200)) asm volatile ("cli");
+}
@@ -0,0 +1,17 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* PIT channel 0 drives IRQ0 at TIMER_HZ, so one tick is one millisecond */
+#define TIMER_HZ 1000
+
+void timer_init(void);
+
+/* milliseconds since timer_init (wraps after ~49 days) */
+uint32_t timer_ticks(void);
+
+/* halt the CPU until at least 'ms' milliseconds have passed */
+void ksleep_ms(uint32_t ms);
+
+#endif
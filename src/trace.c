@@ -0,0 +1,151 @@
+/* trace.c - RDTSC event ring and per-id latency histograms.
+   See trace.h for the model and src/trace2json.py for the export format.
+*/
+
+#include "trace.h"
+#include "timer.h"
+#include "serial.h"
+#include "kformat.h"
+#include "kstring.h"
+
+static trace_event_t ring[TRACE_RING_EVENTS];
+static volatile uint32_t ring_pos; /* total events ever claimed */
+static uint32_t hist[TRACE_NUM_IDS][TRACE_HIST_BUCKETS];
+static uint32_t hist_count[TRACE_NUM_IDS];
+static uint64_t hist_max[TRACE_NUM_IDS];
+static uint32_t tsc_khz;
+static int enabled = 1;
+
+static const char *const names[TRACE_SYSCALL_BASE] = {
+    "ata_read", "ata_write", "fs_meta_read", "fs_meta_write",
+    "fs_init", "fs_sync", "fs_list", "fs_open", "fs_pread", "fs_pwrite",
+    "fs_close", "fs_read_file", "fs_write_file", "fs_remove", "elf_run",
+    "con_flush", "page_fault",
+};
+
+static void record(uint16_t id, uint8_t type, uint32_t arg, uint64_t tsc) {
+    uint32_t slot = __atomic_fetch_add(&ring_pos, 1, __ATOMIC_RELAXED);
+    trace_event_t *ev = &ring[slot & (TRACE_RING_EVENTS - 1)];
+    ev->tsc = tsc;
+    ev->id = id;
+    ev->type = type;
+    ev->reserved = 0;
+    ev->arg = arg;
+}
+
+static int log2_u64(uint64_t v) {
+    uint32_t hi = (uint32_t)(v >> 32);
+    if (hi) return 63 - __builtin_clz(hi);
+    return v ? 31 - __builtin_clz((uint32_t)v) : 0;
+}
+
+uint64_t trace_begin(uint16_t id, uint32_t arg) {
+    if (!enabled || id >= TRACE_NUM_IDS) return 0;
+    uint64_t now = trace_now();
+    record(id, TRACE_EV_BEGIN, arg, now);
+    return now;
+}
+
+void trace_end(uint16_t id, uint64_t start) {
+    if (!start || id >= TRACE_NUM_IDS) return;
+    uint64_t now = trace_now();
+    record(id, TRACE_EV_END, 0, now);
+    uint64_t dt = now - start;
+    int b = log2_u64(dt);
+    if (b >= TRACE_HIST_BUCKETS) b = TRACE_HIST_BUCKETS - 1;
+    hist[id][b]++;
+    hist_count[id]++;
+    if (dt > hist_max[id]) hist_max[id] = dt;
+}
+
+void trace_init(void) {
+    /* count TSC ticks across 10 PIT milliseconds, starting on a tick edge */
+    uint32_t t = timer_ticks();
+    while (timer_ticks() == t) __asm__ volatile ("hlt");
+    uint64_t start = trace_now();
+    ksleep_ms(10);
+    tsc_khz = (uint32_t)(trace_now() - start) / 10;
+}
+
+void trace_set_enabled(int on) {
+    enabled = on;
+}
+
+int trace_enabled(void) {
+    return enabled;
+}
+
+void trace_clear(void) {
+    kmemset(hist, 0, sizeof(hist));
+    kmemset(hist_count, 0, sizeof(hist_count));
+    kmemset(hist_max, 0, sizeof(hist_max));
+    ring_pos = 0;
+}
+
+uint32_t trace_tsc_khz(void) {
+    return tsc_khz;
+}
+
+const char *trace_name(uint16_t id, char *buf, int size) {
+    if (id < TRACE_SYSCALL_BASE) return names[id];
+    ksnprintf(buf, size, "syscall_%u", (unsigned)(id - TRACE_SYSCALL_BASE));
+    return buf;
+}
+
+/* upper bound of the bucket that holds the rank'th smallest sample */
+static uint64_t bucket_bound(uint16_t id, uint32_t rank) {
+    uint32_t seen = 0;
+    for (int b = 0; b < TRACE_HIST_BUCKETS; b++) {
+        seen += hist[id][b];
+        if (seen > rank) return (uint64_t)2 << b;
+    }
+    return hist_max[id];
+}
+
+int trace_get_stats(uint16_t id, trace_stats_t *out) {
+    if (id >= TRACE_NUM_IDS) return -1;
+    uint32_t n = hist_count[id];
+    out->count = n;
+    out->max = hist_max[id];
+    out->p50 = n ? bucket_bound(id, n / 2) : 0;
+    out->p99 = n ? bucket_bound(id, n - 1 - n / 100) : 0;
+    /* a bucket bound can overshoot the largest sample */
+    if (out->p50 > out->max) out->p50 = out->max;
+    if (out->p99 > out->max) out->p99 = out->max;
+    return 0;
+}
+
+/* Export layout, little endian:
+     "BTRC" u16 version u16 event_size u32 tsc_khz u32 nevents u16 nids u16 0
+     nids x { u8 len, name bytes }
+     nevents x trace_event_t, oldest first */
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t tsc_khz;
+    uint32_t nevents;
+    uint16_t nids;
+    uint16_t reserved;
+} __attribute__((packed)) trace_export_hdr_t;
+
+void trace_export_serial(void) {
+    int was = enabled;
+    enabled = 0; /* keep the ring still while it is sent */
+    uint32_t end = ring_pos;
+    uint32_t n = end < TRACE_RING_EVENTS ? end : TRACE_RING_EVENTS;
+    trace_export_hdr_t hdr = { { 'B', 'T', 'R', 'C' }, 1, sizeof(trace_event_t),
+                               tsc_khz, n, TRACE_NUM_IDS, 0 };
+    serial_write(SERIAL_COM1, (const char*)&hdr, sizeof(hdr));
+    for (uint16_t id = 0; id < TRACE_NUM_IDS; id++) {
+        char buf[16];
+        const char *name = trace_name(id, buf, sizeof(buf));
+        uint8_t len = (uint8_t)kstrlen(name);
+        serial_write(SERIAL_COM1, (const char*)&len, 1);
+        serial_write(SERIAL_COM1, name, len);
+    }
+    for (uint32_t i = end - n; i != end; i++)
+        serial_write(SERIAL_COM1, (const char*)&ring[i & (TRACE_RING_EVENTS - 1)], sizeof(trace_event_t));
+    serial_flush();
+    enabled = was;
+}
@@ -0,0 +1,104 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Kernel event tracing. Every traced operation records a begin and an end
+   event, stamped with RDTSC, into a fixed ring of TRACE_RING_EVENTS
+   entries (older events are overwritten), and adds its duration to a
+   per-id log2 histogram. Slots are claimed with an atomic add, so tracing
+   takes no lock; IRQ handlers are not traced. */
+
+#define TRACE_RING_EVENTS 4096 /* power of two */
+#define TRACE_HIST_BUCKETS 40  /* bucket b counts durations in [2^b, 2^(b+1)) cycles */
+#define TRACE_SYSCALLS 32      /* syscall numbers with their own id */
+
+enum {
+    TRACE_ATA_READ,
+    TRACE_ATA_WRITE,
+    TRACE_FS_META_READ,
+    TRACE_FS_META_WRITE,
+    TRACE_FS_INIT,
+    TRACE_FS_SYNC,
+    TRACE_FS_LIST,
+    TRACE_FS_OPEN,
+    TRACE_FS_PREAD,
+    TRACE_FS_PWRITE,
+    TRACE_FS_CLOSE,
+    TRACE_FS_READ_FILE,
+    TRACE_FS_WRITE_FILE,
+    TRACE_FS_REMOVE,
+    TRACE_ELF_RUN,
+    TRACE_CON_FLUSH,
+    TRACE_PAGE_FAULT,
+    TRACE_SYSCALL_BASE,
+    TRACE_NUM_IDS = TRACE_SYSCALL_BASE + TRACE_SYSCALLS
+};
+
+/* syscall numbers outside the table share the id of syscall 0, which is unused */
+#define TRACE_SYSCALL(n) (TRACE_SYSCALL_BASE + ((uint32_t)(n) < TRACE_SYSCALLS ? (uint32_t)(n) : 0))
+
+#define TRACE_EV_BEGIN 1
+#define TRACE_EV_END   2
+
+typedef struct {
+    uint64_t tsc;
+    uint16_t id;
+    uint8_t type; /* TRACE_EV_BEGIN / TRACE_EV_END */
+    uint8_t reserved;
+    uint32_t arg;
+} trace_event_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t p50; /* upper bound of the bucket holding the median, cycles */
+    uint64_t p99;
+    uint64_t max;
+} trace_stats_t;
+
+/* raw TSC; also usable before trace_init */
+static inline uint64_t trace_now(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* calibrate the TSC against the PIT; needs the timer running and IF set */
+void trace_init(void);
+void trace_set_enabled(int on);
+int trace_enabled(void);
+void trace_clear(void);
+
+/* returns the start timestamp to hand to trace_end, or 0 when disabled */
+uint64_t trace_begin(uint16_t id, uint32_t arg);
+void trace_end(uint16_t id, uint64_t start);
+
+/* TSC ticks per millisecond, 0 until trace_init has run */
+uint32_t trace_tsc_khz(void);
+const char *trace_name(uint16_t id, char *buf, int size);
+int trace_get_stats(uint16_t id, trace_stats_t *out);
+
+/* write the ring to COM1 in the binary format read by trace2json.py */
+void trace_export_serial(void);
+
+/* trace the rest of the enclosing block; the end event is recorded on
+   every return path */
+typedef struct {
+    uint16_t id;
+    uint64_t start;
+} trace_scope_t;
+
+static inline void trace_scope_end(trace_scope_t *s) {
+    trace_end(s->id, s->start);
+}
+
+#define TRACE_SCOPE(id, arg) \
+    trace_scope_t trace_scope_ __attribute__((cleanup(trace_scope_end))) = \
+        { (uint16_t)(id), trace_begin((uint16_t)(id), (uint32_t)(arg)) }
+
+/* record the enclosing TRACE_SCOPE's end event now, for a block that is
+   left without returning (elf_exit unwinds past it) */
+#define TRACE_SCOPE_END() \
+    do { trace_scope_end(&trace_scope_); trace_scope_.start = 0; } while (0)
+
+#endif
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Convert a `trace export` capture into Chrome trace JSON.
+
+Run the kernel with the serial port going to a file, for example
+`qemu-system-i386 ... -serial file:serial.log`, type `trace export` in the
+shell, then:
+
+    python3 src/trace2json.py serial.log > trace.json
+
+and open trace.json in chrome://tracing or https://ui.perfetto.dev.
+The capture may contain ordinary console text; the last export in it is used.
+"""
+
+import json
+import struct
+import sys
+
+HDR = struct.Struct("<4sHHIIHH")
+EV_BEGIN, EV_END = 1, 2
+
+
+def parse(data):
+    at = data.rfind(b"BTRC")
+    if at < 0:
+        raise ValueError("no BTRC export found")
+    magic, version, ev_size, khz, nevents, nids, _ = HDR.unpack_from(data, at)
+    if version != 1 or ev_size != 16:
+        raise ValueError("unsupported export version %d / event size %d" % (version, ev_size))
+    off = at + HDR.size
+    names = []
+    for _ in range(nids):
+        n = data[off]
+        names.append(data[off + 1:off + 1 + n].decode("ascii", "replace"))
+        off += 1 + n
+    events = []
+    for _ in range(nevents):
+        if off + 16 > len(data):
+            break  # capture cut short
+        tsc, eid, etype, _, arg = struct.unpack_from("<QHBBI", data, off)
+        events.append((tsc, eid, etype, arg))
+        off += 16
+    return khz, names, events
+
+
+def to_chrome(khz, names, events):
+    out = []
+    if not events:
+        return {"traceEvents": out}
+    base = events[0][0]
+    per_us = khz / 1000.0 if khz else 1.0
+    depth = 0
+    for tsc, eid, etype, arg in events:
+        name = names[eid] if eid < len(names) else "id_%d" % eid
+        ts = (tsc - base) / per_us
+        if etype == EV_BEGIN:
+            depth += 1
+            out.append({"name": name, "ph": "B", "ts": ts, "pid": 1, "tid": 1, "args": {"arg": arg}})
+        elif etype == EV_END:
+            if depth == 0:
+                continue  # its begin was overwritten in the ring
+            depth -= 1
+            out.append({"name": name, "ph": "E", "ts": ts, "pid": 1, "tid": 1})
+    return {"traceEvents": out, "displayTimeUnit": "ns",
+            "otherData": {"tsc_khz": khz, "time_unit": "us" if khz else "cycles"}}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: trace2json.py <serial capture>\n")
+        return 2
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    try:
+        khz, names, events = parse(data)
+    except (ValueError, struct.error, IndexError) as e:
+        sys.stderr.write("trace2json: %s\n" % e)
+        return 1
+    json.dump(to_chrome(khz, names, events), sys.stdout)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,48 @@
+/* user_entry.s - entering ring 3 and coming back.
+ * user_enter(eip, esp) saves the callee-saved registers and EFLAGS on the
+ * kernel stack, records that spot as the thread's kernel stack (so traps
+ * from ring 3 land below it) and irets to ring 3. user_resume(frame, code)
+ * is how the program gets back: it drops whatever is on the kernel stack
+ * above 'frame' and returns 'code' from user_enter.
+ */
+    .section .text
+
+    .globl user_enter
+user_enter:
+    pushl %ebp
+    pushl %ebx
+    pushl %esi
+    pushl %edi
+    pushfl
+    pushl %esp
+    call sched_set_kernel_stack
+    addl $4, %esp
+    movl 24(%esp), %eax             /* eip */
+    movl 28(%esp), %ecx             /* esp */
+    movw $0x23, %dx                 /* GDT_USER_DATA */
+    movw %dx, %ds
+    movw %dx, %es
+    movw %dx, %fs
+    movw %dx, %gs
+    pushl $0x23                     /* ss */
+    pushl %ecx
+    pushl $0x202                    /* eflags: IF */
+    pushl $0x1B                     /* cs: GDT_USER_CODE */
+    pushl %eax
+    iret
+
+    .globl user_resume
+user_resume:
+    movl 8(%esp), %eax
+    movl 4(%esp), %esp
+    movw $0x10, %dx                 /* GDT_KERNEL_DATA */
+    movw %dx, %ds
+    movw %dx, %es
+    movw %dx, %fs
+    movw %dx, %gs
+    popfl
+    popl %edi
+    popl %esi
+    popl %ebx
+    popl %ebp
+    ret
@@ -1,15 +1,34 @@
-/* ascii_ray.c - VGA TEXT MODE ASCII RAYCASTER (no syscalls) */
+/* user_ray.c - MODE 13H RAYCASTER
+   Renders each frame into a buffer of its own, hands it over with one
+   blit syscall instead of one putpixel trap per pixel, and presents it
+   at vertical retrace. Frames start on a fixed 33 ms schedule. */
 
 #include <stdint.h>
 
-#define VGA_MEM  ((uint16_t*)0xB8000)
-#define SCREEN_W 80
-#define SCREEN_H 25
+#define SCREEN_W 320
+#define SCREEN_H 200
 
 #define MAP_W 8
 #define MAP_H 3
 #define FOV    1.0f
 #define DEPTH 16.0f
+#define FRAME_MS 33 /* ~30 frames per second */
+
+/* syscall numbers and argument packing, as in src/syscall.h */
+#define SYS_MODE13     8
+#define SYS_SLEEP      13
+#define SYS_TICKS      14
+#define SYS_BLIT13     16
+#define SYS_SETPALETTE 17
+#define SYS_PRESENT    20
+#define XY(x, y) (((uint32_t)(y) << 16) | (uint32_t)(x))
+#define WH(w, h) (((uint32_t)(h) << 16) | (uint32_t)(w))
+
+/* palette layout: four 64-entry ramps */
+#define PAL_WALL  0
+#define PAL_DOOR  64
+#define PAL_CEIL  128
+#define PAL_FLOOR 192
 
 /* tiny map */
 static char mapData[MAP_H][MAP_W+1] = {
@@ -22,6 +41,15 @@ float playerX = 4.0f;
 float playerY = 1.5f;
 float playerA = 0.0f;
 
+static uint8_t frame[SCREEN_H][SCREEN_W];
+static uint8_t palette[256 * 3];
+
+static uint32_t syscall3(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t ret;
+    asm volatile ("int $0x80" : "=a"(ret) : "a"(num), "b"(a), "c"(b), "d"(c) : "memory");
+    return ret;
+}
+
 /* small sine/cosine approximations */
 static float fsin(float x) {
     const float PI = 3.1415926535f;
@@ -32,18 +60,22 @@ static float fsin(float x) {
 }
 static float fcos(float x) { return fsin(x + 1.57079632679f); }
 
-/* Write ASCII char + color to 80×25 text VGA */
-static void putChar(int x, int y, char c, uint8_t color) {
-    VGA_MEM[y * SCREEN_W + x] = (color << 8) | c;
+/* ramp 'base'..'base'+63 from black to (r,g,b) */
+static void ramp(int base, int r, int g, int b) {
+    for (int i = 0; i < 64; i++) {
+        palette[(base + i) * 3 + 0] = (uint8_t)(r * i / 63);
+        palette[(base + i) * 3 + 1] = (uint8_t)(g * i / 63);
+        palette[(base + i) * 3 + 2] = (uint8_t)(b * i / 63);
+    }
 }
 
-/* Clear screen */
-static void clear(uint8_t col) {
-    for (int i = 0; i < SCREEN_W * SCREEN_H; i++)
-        VGA_MEM[i] = (col << 8) | ' ';
+/* brightness 0..63 for a wall 'dist' away */
+static uint8_t shade(float dist) {
+    if (dist >= DEPTH) return 0;
+    return (uint8_t)(63.0f * (1.0f - dist / DEPTH));
 }
 
-/* Render one ASCII frame */
+/* Render one frame into 'frame' */
 static void render() {
     for (int x = 0; x < SCREEN_W; x++) {
 
@@ -71,24 +103,16 @@ static void render() {
         int ceiling = (SCREEN_H/2) - (float)SCREEN_H / dist;
         if (ceiling < 0) ceiling = 0;
         int floor = SCREEN_H - ceiling;
+        uint8_t wall = (hit == 'D' ? PAL_DOOR : PAL_WALL) + shade(dist);
 
         for (int y = 0; y < SCREEN_H; y++) {
             if (y < ceiling) {
-                putChar(x, y, ' ', 1);
+                frame[y][x] = PAL_CEIL + 16;
             } else if (y < floor) {
-
-                /* ASCII shading based on distance */
-                char shade;
-                if (dist <= DEPTH / 4) shade = '#';
-                else if (dist <= DEPTH / 3) shade = 'O';
-                else if (dist <= DEPTH / 2) shade = 'o';
-                else if (dist <= DEPTH) shade = '.';
-                else shade = ' ';
-
-                putChar(x, y, shade, 15);
-
+                frame[y][x] = wall;
             } else {
-                putChar(x, y, '.', 8);
+                /* floor brightens toward the viewer */
+                frame[y][x] = PAL_FLOOR + (y - SCREEN_H/2) * 63 / (SCREEN_H/2);
             }
         }
     }
@@ -96,15 +120,27 @@ static void render() {
 
 /* main entry */
 void entry() {
-    clear(0);
-
+    syscall3(SYS_MODE13, 0, 0, 0);
+    ramp(PAL_WALL, 255, 255, 255);
+    ramp(PAL_DOOR, 255, 160, 64);
+    ramp(PAL_CEIL, 64, 96, 255);
+    ramp(PAL_FLOOR, 128, 128, 128);
+    syscall3(SYS_SETPALETTE, (uint32_t)palette, 0, 256);
+
+    uint32_t next = syscall3(SYS_TICKS, 0, 0, 0);
     for (;;) {
         playerA += 0.05f;
         if (playerA > 6.28f) playerA -= 6.28f;
 
         render();
-
-        /* simple stall */
-       // for (volatile int i = 0; i < 2000000; i++) { }
+        syscall3(SYS_BLIT13, (uint32_t)frame, XY(0, 0), WH(SCREEN_W, SCREEN_H));
+        syscall3(SYS_PRESENT, 0, 0, 0);
+
+        /* sleep out the rest of this frame's slot, so render and retrace
+           time do not stretch the frame; skip ahead if far behind */
+        next += FRAME_MS;
+        int32_t left = (int32_t)(next - syscall3(SYS_TICKS, 0, 0, 0));
+        if (left > 0) syscall3(SYS_SLEEP, (uint32_t)left, 0, 0);
+        else if (left < -FRAME_MS) next = syscall3(SYS_TICKS, 0, 0, 0);
     }
 }
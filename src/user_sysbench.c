@@ -0,0 +1,83 @@
+/* user_sysbench.c - system call round-trip cost, int 0x80 vs SYSENTER.
+   Times ROUNDS calls of each kind with rdtsc and prints cycles per call.
+   The timed call is SYS_WRITE with a zero length, so the kernel does no
+   work beyond dispatch. Run with "trace off" for the raw entry cost. */
+
+#include <stdint.h>
+
+#define SYS_PRINT 1
+#define SYS_WRITE 2
+
+#define ROUNDS 10000
+
+/* low half only: a run takes far fewer than 2^32 cycles */
+static inline uint32_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static uint32_t call_int80(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t ret;
+    asm volatile ("int $0x80" : "=a"(ret) : "a"(num), "b"(a), "c"(b), "d"(c) : "memory");
+    return ret;
+}
+
+/* the stack convention from src/syscall.h */
+static uint32_t call_sysenter(uint32_t num, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t ret;
+    asm volatile (
+        "pushl %%edx\n\t"
+        "pushl %%ecx\n\t"
+        "pushl $1f\n\t"
+        "movl %%esp, %%ecx\n\t"
+        "sysenter\n"
+        "1:\n\t"
+        "addl $12, %%esp"
+        : "=a"(ret), "+c"(b), "+d"(c)
+        : "a"(num), "b"(a)
+        : "memory");
+    return ret;
+}
+
+static int has_sysenter(void) {
+    uint32_t a = 1, b, c = 0, d;
+    asm volatile ("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    /* same test as gdt_init: early Pentium Pros claim SEP falsely */
+    if (((a >> 8) & 0xF) == 6 && ((a >> 4) & 0xF) < 3 && (a & 0xF) < 3) return 0;
+    return (d >> 11) & 1;
+}
+
+static void print(const char *s) {
+    call_int80(SYS_PRINT, (uint32_t)s, 0, 0);
+}
+
+static void print_u(uint32_t v) {
+    char buf[12];
+    int i = sizeof(buf) - 1;
+    buf[i] = 0;
+    do { buf[--i] = (char)('0' + v % 10); v /= 10; } while (v);
+    print(&buf[i]);
+}
+
+static uint32_t measure(uint32_t (*call)(uint32_t, uint32_t, uint32_t, uint32_t)) {
+    call(SYS_WRITE, 0, 0, 0); /* warm up */
+    uint32_t t0 = rdtsc();
+    for (int i = 0; i < ROUNDS; i++) call(SYS_WRITE, 0, 0, 0);
+    return (rdtsc() - t0) / ROUNDS;
+}
+
+int entry(void) {
+    print("int 0x80: ");
+    print_u(measure(call_int80));
+    print(" cycles/call\n");
+
+    print("sysenter: ");
+    if (has_sysenter()) {
+        print_u(measure(call_sysenter));
+        print(" cycles/call\n");
+    } else {
+        print("not supported\n");
+    }
+    return 0;
+}
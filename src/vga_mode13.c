@@ -5,6 +5,8 @@
 #include "vga_mode13.h"
 #include <stdint.h>
 #include "io.h"
+#include "kstring.h"
+#include "timer.h"
 
 /* port I/O */
 static inline void outb(uint16_t port, uint8_t val) {
@@ -16,6 +18,13 @@ static inline uint8_t inb(uint16_t port) {
     return ret;
 }
 
+#define VGA13_FB ((uint8_t*)0xA0000)
+#define RETRACE_WAIT_MS 30 /* about two frames at 70 Hz */
+
+/* everything drawn lands here first; vga_present copies the dirty part */
+static uint8_t backbuf[VGA13_W * VGA13_H];
+static int dirty_x0, dirty_y0, dirty_x1, dirty_y1; /* empty when x1 <= x0 */
+
 /* Mode 13h register values */
 static const uint8_t seq_regs[5] = { 0x03, 0x01, 0x0F, 0x00, 0x0E };
 static const uint8_t crtc_regs[25] = {
@@ -128,6 +137,8 @@ void vga_set_mode13(void) {
     outb(0x3D5, 0x20);
     
     write_regs_mode13();
+    /* VRAM holds whatever the last mode left; the next present replaces it */
+    vga_mark_dirty(0, 0, VGA13_W, VGA13_H);
 }
 
 void vga_set_text_mode(void) {
@@ -161,23 +172,104 @@ void vga_set_palette_default(void) {
     }
 }
 
+void vga_set_palette(int first, int count, const uint8_t *rgb) {
+    if (first < 0 || count <= 0 || first > 255) return;
+    if (count > 256 - first) count = 256 - first;
+    outb(0x3C8, (uint8_t)first); /* the DAC index auto-increments */
+    for (int i = 0; i < count * 3; i++) outb(0x3C9, rgb[i] >> 2);
+}
+
+void vga_mark_dirty(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) return;
+    if (dirty_x1 <= dirty_x0) {
+        dirty_x0 = x; dirty_y0 = y; dirty_x1 = x + w; dirty_y1 = y + h;
+    } else {
+        if (x < dirty_x0) dirty_x0 = x;
+        if (y < dirty_y0) dirty_y0 = y;
+        if (x + w > dirty_x1) dirty_x1 = x + w;
+        if (y + h > dirty_y1) dirty_y1 = y + h;
+    }
+    if (dirty_x0 < 0) dirty_x0 = 0;
+    if (dirty_y0 < 0) dirty_y0 = 0;
+    if (dirty_x1 > VGA13_W) dirty_x1 = VGA13_W;
+    if (dirty_y1 > VGA13_H) dirty_y1 = VGA13_H;
+}
+
+uint8_t *vga_backbuffer(void) {
+    return backbuf;
+}
+
+int vga_blit13(int x, int y, int w, int h, const uint8_t *src, int pitch) {
+    if (w <= 0 || h <= 0) return -1;
+    if (x < 0) { src -= x; w += x; x = 0; }
+    if (y < 0) { src -= y * pitch; h += y; y = 0; }
+    if (x + w > VGA13_W) w = VGA13_W - x;
+    if (y + h > VGA13_H) h = VGA13_H - y;
+    if (w <= 0 || h <= 0) return -1;
+    uint8_t *dst = backbuf + y * VGA13_W + x;
+    if (x == 0 && w == VGA13_W && pitch == VGA13_W) {
+        kmemcpy(dst, src, (size_t)h * VGA13_W); /* whole rows: one copy */
+    } else {
+        for (int r = 0; r < h; r++, dst += VGA13_W, src += pitch) kmemcpy(dst, src, (size_t)w);
+    }
+    vga_mark_dirty(x, y, w, h);
+    return 0;
+}
+
 void vga_putpixel(int x, int y, uint8_t color) {
-    if (x < 0 || x >= 320 || y < 0 || y >= 200) return;
-    volatile uint8_t *fb = (volatile uint8_t*)0xA0000;
-    fb[y * 320 + x] = color;
+    if (x < 0 || x >= VGA13_W || y < 0 || y >= VGA13_H) return;
+    backbuf[y * VGA13_W + x] = color;
+    vga_mark_dirty(x, y, 1, 1);
 }
 
 void vga_clear_mode13(uint8_t color) {
-    volatile uint8_t *fb = (volatile uint8_t*)0xA0000;
-    for (int i = 0; i < 320*200; i++) fb[i] = color;
+    kmemset(backbuf, color, sizeof(backbuf));
+    vga_mark_dirty(0, 0, VGA13_W, VGA13_H);
 }
 
+/* wait for the start of the next vertical retrace, giving up after
+   RETRACE_WAIT_MS on adapters whose status bit never toggles; needs
+   interrupts on for the deadline to pass */
+static void wait_retrace(void) {
+    uint32_t start = timer_ticks();
+    /* let a retrace already under way end */
+    while ((inb(0x3DA) & 0x08) && timer_ticks() - start < RETRACE_WAIT_MS) ;
+    while (!(inb(0x3DA) & 0x08) && timer_ticks() - start < RETRACE_WAIT_MS) ;
+}
 
-void vga_clear_screen(void) {
-    /* Clear text screen by writing spaces to video memory */
-    volatile uint16_t *vram = (volatile uint16_t*)0xB8000;
-    for (int i = 0; i < 80*25; i++) {
-        vram[i] = 0x0720; /* white on black space */
+/* copy rows y0..y1, columns x0..x1 of the back buffer to VRAM */
+static void copy_rect(int x0, int y0, int x1, int y1) {
+    int w = x1 - x0;
+    uint8_t *dst = VGA13_FB + y0 * VGA13_W + x0;
+    const uint8_t *src = backbuf + y0 * VGA13_W + x0;
+    if (w == VGA13_W) {
+        kmemcpy(dst, src, (size_t)(y1 - y0) * VGA13_W);
+    } else {
+        for (int y = y0; y < y1; y++, dst += VGA13_W, src += VGA13_W)
+            kmemcpy(dst, src, (size_t)w);
     }
-    vga_set_cursor(0, 0);
+}
+
+void vga_show_now(int x, int y, int w, int h) {
+    int x1 = x + w, y1 = y + h;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > VGA13_W) x1 = VGA13_W;
+    if (y1 > VGA13_H) y1 = VGA13_H;
+    if (x1 > x && y1 > y) copy_rect(x, y, x1, y1);
+}
+
+int vga_present(void) {
+    if (dirty_x1 <= dirty_x0) return 0; /* nothing changed since the last present */
+    wait_retrace();
+    copy_rect(dirty_x0, dirty_y0, dirty_x1, dirty_y1);
+    dirty_x0 = dirty_x1 = dirty_y0 = dirty_y1 = 0;
+    return 1;
+}
+
+
+void vga_clear_screen(void) {
+    /* Clear text screen through the console so its shadow buffer agrees */
+    vga_set_color(COLOR_LIGHT_GRAY, COLOR_BLACK);
+    vga_clear();
 }
\ No newline at end of file
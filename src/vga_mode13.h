@@ -3,6 +3,17 @@
 
 #include <stdint.h>
 
+/* Mode 13h drawing is double-buffered: vga_putpixel, vga_clear_mode13
+   and vga_blit13 write a 64 KB back buffer in RAM and only widen a dirty
+   rectangle. vga_present waits for vertical retrace and copies that
+   rectangle to VRAM in one pass, so a frame never shows half drawn and
+   an unchanged screen costs no VRAM writes at all. Callers that draw
+   into vga_backbuffer() directly report what they touched with
+   vga_mark_dirty. */
+
+#define VGA13_W 320
+#define VGA13_H 200
+
 /* Set VGA to 320x200x256 mode (mode 13h) */
 void vga_set_mode13(void);
 
@@ -12,12 +23,34 @@ void vga_set_text_mode(void);
 /* Set default 6x6x6 color palette */
 void vga_set_palette_default(void);
 
+/* Load 'count' palette entries from 'first' on; rgb holds 8-bit R,G,B
+   triples (the DAC keeps the top 6 bits) */
+void vga_set_palette(int first, int count, const uint8_t *rgb);
+
+/* Copy a w x h block of 'pitch'-byte rows to (x,y) in the back buffer,
+   clipped to the screen; -1 if nothing of it is on screen */
+int vga_blit13(int x, int y, int w, int h, const uint8_t *src, int pitch);
+
 /* Draw a pixel at (x,y) with color */
 void vga_putpixel(int x, int y, uint8_t color);
 
 /* Clear entire mode13 screen with color */
 void vga_clear_mode13(uint8_t color);
 
+/* The back buffer, VGA13_W x VGA13_H bytes, and the call that records a
+   rectangle of it as changed */
+uint8_t *vga_backbuffer(void);
+void vga_mark_dirty(int x, int y, int w, int h);
+
+/* Copy the dirty rectangle to VRAM at the next vertical retrace (or
+   after about two frames if no retrace is seen); returns 0 without
+   waiting when nothing is dirty, 1 after a copy */
+int vga_present(void);
+
+/* Copy a rectangle of the back buffer to VRAM right away, without
+   waiting for retrace or touching the dirty rectangle */
+void vga_show_now(int x, int y, int w, int h);
+
 /* Clear text mode screen */
 void vga_clear_screen(void);
 
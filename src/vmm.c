@@ -0,0 +1,184 @@
+/* vmm.c - page directories and demand paging for program address spaces.
+   Page tables and user frames come from the PMM and are touched through
+   the kernel's identity map, so the fault handler fills a new frame at
+   its physical address and only then maps it at the faulting address.
+*/
+
+#include "vmm.h"
+#include "pmm.h"
+#include "fs.h"
+#include "kmalloc.h"
+#include "kstring.h"
+#include "trace.h"
+
+#define USER_PDE_FIRST  (USER_BASE >> 22)
+#define USER_PDE_END    (USER_LIMIT >> 22)
+
+static uint32_t kernel_pd[1024] __attribute__((aligned(4096)));
+static uint32_t low_pt[1024] __attribute__((aligned(4096))); /* first 4 MB for programs */
+static vmm_space_t *current;
+static vmm_stats_t stats;
+static int paging_on;
+
+static inline void load_cr3(uint32_t pd) {
+    asm volatile ("mov %0, %%cr3" :: "r"(pd) : "memory");
+}
+
+int vmm_init(void) {
+    uint32_t a = 1, b, c = 0, d;
+    asm volatile ("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    if (!(d & (1u << 3))) return -1; /* PSE */
+
+    /* all 4 GB, so MMIO such as a linear framebuffer stays reachable */
+    for (uint32_t i = 0; i < 1024; i++)
+        kernel_pd[i] = (i << 22) | PTE_PRESENT | PTE_WRITE | PDE_4MB;
+    for (uint32_t i = 0; i < 1024; i++) {
+        uint32_t addr = i * VMM_PAGE_SIZE;
+        low_pt[i] = addr | PTE_PRESENT | PTE_WRITE;
+        if (addr >= USER_VGA_BASE && addr < USER_VGA_LIMIT) low_pt[i] |= PTE_USER;
+    }
+
+    uint32_t cr;
+    asm volatile ("mov %%cr4, %0" : "=r"(cr));
+    asm volatile ("mov %0, %%cr4" :: "r"(cr | (1u << 4)));   /* PSE */
+    load_cr3((uint32_t)(uintptr_t)kernel_pd);
+    asm volatile ("mov %%cr0, %0" : "=r"(cr));
+    /* PG, and WP so read-only program pages are enforced in ring 0 too */
+    asm volatile ("mov %0, %%cr0" :: "r"(cr | (1u << 31) | (1u << 16)) : "memory");
+    paging_on = 1;
+    return 0;
+}
+
+int vmm_enabled(void) {
+    return paging_on;
+}
+
+vmm_space_t *vmm_create(int fd) {
+    if (!paging_on) return 0;
+    vmm_space_t *vs = (vmm_space_t*)kzalloc(sizeof(vmm_space_t));
+    if (!vs) return 0;
+    vs->pd = pmm_alloc_frame();
+    if (!vs->pd) { kfree(vs); return 0; }
+    uint32_t *pd = (uint32_t*)(uintptr_t)vs->pd;
+    kmemcpy(pd, kernel_pd, sizeof(kernel_pd));
+    for (uint32_t i = USER_PDE_FIRST; i < USER_PDE_END; i++) pd[i] = 0;
+    pd[0] = (uint32_t)(uintptr_t)low_pt | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    vs->fd = fd;
+    return vs;
+}
+
+void vmm_destroy(vmm_space_t *vs) {
+    if (!vs) return;
+    if (current == vs) vmm_switch(0);
+    uint32_t *pd = (uint32_t*)(uintptr_t)vs->pd;
+    for (uint32_t i = USER_PDE_FIRST; i < USER_PDE_END; i++) {
+        if (!(pd[i] & PTE_PRESENT)) continue;
+        uint32_t *pt = (uint32_t*)(uintptr_t)(pd[i] & ~0xFFFu);
+        for (int j = 0; j < 1024; j++)
+            if (pt[j] & PTE_PRESENT) pmm_free_frame(pt[j] & ~0xFFFu);
+        pmm_free_frame(pd[i] & ~0xFFFu);
+    }
+    pmm_free_frame(vs->pd);
+    if (vs->fd >= 0) fs_close(vs->fd);
+    kfree(vs);
+}
+
+int vmm_add_area(vmm_space_t *vs, uint32_t start, uint32_t end,
+                 uint32_t file_off, uint32_t file_len, int writable) {
+    if (!vs || vs->nareas >= VMM_MAX_AREAS) return -1;
+    if (start < USER_BASE || end > USER_LIMIT || start >= end) return -1;
+    if (file_len > end - start || (file_len && vs->fd < 0)) return -1;
+    vm_area_t *a = &vs->areas[vs->nareas++];
+    a->start = start;
+    a->end = end;
+    a->file_off = file_off;
+    a->file_len = file_len;
+    a->writable = writable;
+    return 0;
+}
+
+vmm_space_t *vmm_switch(vmm_space_t *vs) {
+    vmm_space_t *prev = current;
+    if (vs != current && paging_on) {
+        current = vs;
+        load_cr3(vs ? vs->pd : (uint32_t)(uintptr_t)kernel_pd);
+    }
+    return prev;
+}
+
+vmm_space_t *vmm_current(void) {
+    return current;
+}
+
+int vmm_check_user(uint32_t addr, uint32_t len, int write) {
+    vmm_space_t *vs = current;
+    if (!vs || addr < USER_BASE || addr >= USER_LIMIT || len > USER_LIMIT - addr) return -1;
+    /* walk the range area by area; areas may abut but never need to be sorted */
+    uint32_t end = addr + len;
+    while (addr < end) {
+        const vm_area_t *hit = 0;
+        for (int i = 0; i < vs->nareas && !hit; i++) {
+            const vm_area_t *a = &vs->areas[i];
+            if (addr >= a->start && addr < a->end) hit = a;
+        }
+        if (!hit || (write && !hit->writable)) return -1;
+        addr = hit->end;
+    }
+    return 0;
+}
+
+/* fill a fresh frame with every area's bytes for the page at 'page' */
+static int fill_page(vmm_space_t *vs, uint32_t page, uint8_t *frame, int *writable) {
+    int found = 0;
+    for (int i = 0; i < vs->nareas; i++) {
+        const vm_area_t *a = &vs->areas[i];
+        if (a->end <= page || a->start >= page + VMM_PAGE_SIZE) continue;
+        found = 1;
+        if (a->writable) *writable = 1;
+        uint32_t lo = a->start > page ? a->start : page;
+        uint32_t hi = a->start + a->file_len;
+        if (hi > page + VMM_PAGE_SIZE) hi = page + VMM_PAGE_SIZE;
+        if (lo >= hi) continue;
+        uint32_t len = hi - lo;
+        if (fs_pread(vs->fd, a->file_off + (lo - a->start), frame + (lo - page), len) != (int)len)
+            return -1;
+        stats.bytes_read += len;
+        stats.file_pages++;
+    }
+    return found ? 0 : -1;
+}
+
+int vmm_page_fault(uint32_t addr, uint32_t err) {
+    vmm_space_t *vs = current;
+    /* only not-present faults inside a program's region are ours */
+    if (!vs || (err & PTE_PRESENT) || addr < USER_BASE || addr >= USER_LIMIT) return -1;
+    TRACE_SCOPE(TRACE_PAGE_FAULT, addr);
+
+    uint32_t page = addr & ~(VMM_PAGE_SIZE - 1);
+    uint32_t *pd = (uint32_t*)(uintptr_t)vs->pd;
+    uint32_t pdi = page >> 22;
+    if (!(pd[pdi] & PTE_PRESENT)) {
+        uint32_t pt = pmm_alloc_frame();
+        if (!pt) return -1;
+        kmemset((void*)(uintptr_t)pt, 0, VMM_PAGE_SIZE);
+        pd[pdi] = pt | PTE_PRESENT | PTE_WRITE | PTE_USER;
+    }
+    uint32_t *pt = (uint32_t*)(uintptr_t)(pd[pdi] & ~0xFFFu);
+
+    uint32_t frame = pmm_alloc_frame();
+    if (!frame) return -1;
+    kmemset((void*)(uintptr_t)frame, 0, VMM_PAGE_SIZE);
+    int writable = 0;
+    if (fill_page(vs, page, (uint8_t*)(uintptr_t)frame, &writable) != 0) {
+        pmm_free_frame(frame);
+        return -1;
+    }
+    pt[(page >> 12) & 1023] = frame | PTE_PRESENT | PTE_USER | (writable ? PTE_WRITE : 0);
+    vs->resident++;
+    stats.faults++;
+    return 0;
+}
+
+void vmm_get_stats(vmm_stats_t *out) {
+    *out = stats;
+}
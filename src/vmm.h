@@ -0,0 +1,83 @@
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+
+/* Paging. The kernel identity-maps all 4 GB with 4 MB pages (PSE),
+   and those directory entries are shared by every address space. Each
+   program gets its own page directory whose user slots
+   (USER_BASE..USER_LIMIT) start empty; pages there are filled
+   on first touch from the areas registered with vmm_add_area, reading
+   file-backed bytes through an open fs handle and zeroing the rest.
+   Kernel pages are supervisor-only. The first 4 MB are mapped for
+   programs through a shared table of 4 KB pages, so that VGA text memory
+   alone can carry the user bit.
+   Physical USER_BASE..USER_LIMIT stays reserved in the PMM because the
+   kernel's identity map of it is hidden while a program's directory is
+   loaded. */
+
+#define USER_BASE  0x00400000u
+#define USER_LIMIT 0x00C00000u /* one past the last user byte */
+
+/* every program gets a demand-zero stack at the top of its region */
+#define USER_STACK_SIZE 0x10000u
+#define USER_STACK_BASE (USER_LIMIT - USER_STACK_SIZE)
+
+/* VGA text memory, the only low page range a program may touch */
+#define USER_VGA_BASE  0x000B8000u
+#define USER_VGA_LIMIT 0x000C0000u
+
+#define VMM_PAGE_SIZE 4096
+#define VMM_MAX_AREAS 8
+
+#define PTE_PRESENT 0x001
+#define PTE_WRITE   0x002
+#define PTE_USER    0x004
+#define PDE_4MB     0x080
+
+typedef struct {
+    uint32_t start, end;  /* virtual range, byte granular */
+    uint32_t file_off;    /* file offset that 'start' maps to */
+    uint32_t file_len;    /* bytes backed by the file; the rest reads as zero */
+    int writable;
+} vm_area_t;
+
+typedef struct {
+    uint32_t pd;          /* physical address of the page directory */
+    int fd;               /* fs handle the areas read from, -1 for none */
+    int nareas;
+    vm_area_t areas[VMM_MAX_AREAS];
+    uint32_t resident;    /* pages faulted in so far */
+} vmm_space_t;
+
+typedef struct {
+    uint32_t faults;      /* page faults resolved */
+    uint32_t file_pages;  /* of those, pages that read file data */
+    uint32_t bytes_read;  /* file bytes read by the fault handler */
+} vmm_stats_t;
+
+/* build the kernel map and turn paging on; -1 if the CPU lacks PSE */
+int vmm_init(void);
+int vmm_enabled(void);
+
+/* a new address space with no user pages; 'fd' is owned by the space
+   and closed by vmm_destroy */
+vmm_space_t *vmm_create(int fd);
+void vmm_destroy(vmm_space_t *vs);
+int vmm_add_area(vmm_space_t *vs, uint32_t start, uint32_t end,
+                 uint32_t file_off, uint32_t file_len, int writable);
+
+/* load vs's page directory (NULL: the kernel's); returns the previous space */
+vmm_space_t *vmm_switch(vmm_space_t *vs);
+vmm_space_t *vmm_current(void);
+
+/* 0 if [addr, addr+len) lies inside the current program's areas (and
+   they are writable, for 'write'); how syscalls check user pointers */
+int vmm_check_user(uint32_t addr, uint32_t len, int write);
+
+/* called from the #PF handler; 0 if the fault was resolved */
+int vmm_page_fault(uint32_t addr, uint32_t err);
+
+void vmm_get_stats(vmm_stats_t *out);
+
+#endif